@@ -2,14 +2,21 @@
 #include <vector>
 #include <random>
 #include <algorithm>
+#include <deque>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
 
 #define SDL_MAIN_USE_CALLBACKS 1  /* use the callbacks instead of main() */
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_main.h>
 #include "structures/Grid.h"
+#include "structures/SimulationThread.h"
+#include "rendering/renderer.h"
 #include "particles/ParticleFactory.h"
 #include "particles/ParticleType.h"
-#include "structures/ThreadGroup.h"
+#include "util/Profiler.h"
 
 
 #define SCREEN_WIDTH 1600
@@ -19,19 +26,82 @@
 static SDL_Window *window = NULL;
 static SDL_Renderer *renderer = NULL;
 
-enum class ActionState{
-    NONE,
-    PLACE,
-    REMOVE
-};
+// owns the Grid once started, everything below talks to it through commands and frames
+static SimulationThread simulation;
 
 static std::pair<int, int> mouse_pos = std::make_pair(0, 0);  // Store mouse position
-static ActionState currentAction = ActionState::NONE;
+static BrushAction currentAction = BrushAction::NONE;
 static ParticleTypeID selectedParticle = ParticleTypeID::SAND;  // Default particle type to place
 static int selectionSize = 5;
 static int gridSpacing = 4;  // Spacing between grid cells in pixels
+static int tickInterval = 10;  // Time in ms between ticks
 static bool is_debug = false;
 
+// world size in cells, the screen's unless --width/--height say otherwise, and
+// the world cell at the window's top left, moved a chunk at a time
+static int world_width = 0;
+static int world_height = 0;
+static int camera_x = 0;
+static int camera_y = 0;
+
+// Simulation ticks picked up during one rendered frame, summed
+struct FrameProfile {
+    int ticks = 0;
+    TickProfile last;       // the newest tick, for its counters
+    uint64_t brush_ns = 0, stamp_ns = 0, activate_ns = 0, sweep_ns = 0, react_ns = 0, level_ns = 0, publish_ns = 0;
+    uint64_t swaps = 0, reacted = 0, levelled = 0;
+    int published_chunks = 0;
+};
+
+static FrameProfile overlay_profile;    // last frame that had ticks, shown in debug mode
+static uint64_t present_ns = 0;         // last SDL_RenderPresent call
+static uint64_t frame_count = 0;
+static ProfileLog profile_log;          // --profile FILE, one row per frame
+
+// Brush commands the simulation's queue had no room for, oldest first
+static std::deque<BrushCommand> unsent_brushes;
+
+// Hand over the unsent commands in order, as many as the queue takes
+static void flushBrushes() {
+    while(!unsent_brushes.empty() && simulation.sendBrush(unsent_brushes.front())) {
+        unsent_brushes.pop_front();
+    }
+}
+
+// Tell the simulation about the current brush, it keeps painting with it every tick
+static void sendBrush() {
+    BrushCommand command;
+    command.action = currentAction;
+    command.x = camera_x + mouse_pos.first / gridSpacing;
+    command.y = camera_y + mouse_pos.second / gridSpacing;
+    command.radius = selectionSize;
+    command.type = selectedParticle;
+
+    // while the queue is full only the latest state of each press or release
+    // has to wait, a release is never lost
+    if(!unsent_brushes.empty() && unsent_brushes.back().action == command.action) {
+        unsent_brushes.back() = command;
+    }else{
+        unsent_brushes.push_back(command);
+    }
+    flushBrushes();
+}
+
+// Scroll the view by whole chunks, keeping some of the world on screen
+static void moveCamera(int chunks_x, int chunks_y) {
+    int view_width = SCREEN_WIDTH / gridSpacing;
+    int view_height = SCREEN_HEIGHT / gridSpacing;
+    int max_x = std::max(world_width - view_width, 0);
+    int max_y = std::max(world_height - view_height, 0);
+
+    // round up so the last chunks can be scrolled fully into view
+    max_x = (max_x + ParticleChunk::CHUNK_SIZE - 1) / ParticleChunk::CHUNK_SIZE * ParticleChunk::CHUNK_SIZE;
+    max_y = (max_y + ParticleChunk::CHUNK_SIZE - 1) / ParticleChunk::CHUNK_SIZE * ParticleChunk::CHUNK_SIZE;
+    camera_x = std::clamp(camera_x + chunks_x * ParticleChunk::CHUNK_SIZE, 0, max_x);
+    camera_y = std::clamp(camera_y + chunks_y * ParticleChunk::CHUNK_SIZE, 0, max_y);
+    simulation.setView(camera_x, camera_y, view_width, view_height);
+}
+
 /* This function runs once at startup. */
 SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]){
     setvbuf(stdout, NULL, _IONBF, 0);
@@ -50,79 +120,40 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]){
         return SDL_APP_FAILURE;
     }
 
+    // --record FILE keeps every brush stroke for falling_sand_replay,
+    // --profile FILE writes where each frame's time went as CSV or .json,
+    // --width W and --height H size the world in cells
+    world_width = SCREEN_WIDTH / gridSpacing;
+    world_height = SCREEN_HEIGHT / gridSpacing;
+    std::string record_path;
+    for(int i = 1; i + 1 < argc; i++) {
+        if(strcmp(argv[i], "--record") == 0) {
+            record_path = argv[i + 1];
+        }else if(strcmp(argv[i], "--width") == 0) {
+            world_width = std::max(atoi(argv[i + 1]), 1);
+        }else if(strcmp(argv[i], "--height") == 0) {
+            world_height = std::max(atoi(argv[i + 1]), 1);
+        }else if(strcmp(argv[i], "--profile") == 0 && !profile_log.open(argv[i + 1], {"frame", "tick", "ticks",
+            "brush_us", "stamp_us", "activate_us", "sweep_us", "react_us", "level_us", "publish_us", "swaps", "reacted", "levelled", "active_chunks",
+            "allocated_chunks", "published_chunks", "render_us", "redrawn_chunks", "present_us"})) {
+            SDL_Log("Couldn't open profile log %s", argv[i + 1]);
+        }
+    }
+
     printf("Initializing ParticleTypeRegistry...\n");
     ParticleTypeRegistry::initialize();
     printf("Initializing Grid...\n");
-    Grid::init(SCREEN_WIDTH/gridSpacing, SCREEN_HEIGHT/gridSpacing);
-    printf("Initialization complete!\n");
+    Grid::init(world_width, world_height);
+    Grid::setThreadCount(std::max(1u, std::thread::hardware_concurrency()));
+    Grid::setCheckerboardUpdate(true);
 
-    // int x = 0;
-    // struct Data{
-    //     int v;
-    // };
-    // ThreadGroup<Data> threadGroup;
-    // threadGroup.initializeThreads(4);
-    // printf("ThreadGroup initialized.\n");
-    // threadGroup.setFunction([](Data& data, int thread_id) {
-    //     printf("Thread %d got value to %d\n", thread_id, data.v);
-    // });
-    // threadGroup.setAllThreadData({Data{0}, Data{1}, Data{2}, Data{3}});
-    // threadGroup.executeAndWait();
-    // printf("ThreadGroup executed and waited!\n");
-    // threadGroup.executeThreads();
-    // printf("ThreadGroup executed again without waiting!\n");
-    // threadGroup.waitForCompletion();
-    // printf("ThreadGroup completed all tasks!\n");
+    moveCamera(0, 0);
+    simulation.start(tickInterval, record_path);
+    printf("Initialization complete!\n");
 
     return SDL_APP_CONTINUE;  /* carry on with the program! */
 }
 
-void onTick(){
-    if(currentAction == ActionState::PLACE) {
-        // Fill the circle with particles
-        int mousex = mouse_pos.first;
-        int mousey = mouse_pos.second;
-
-        for(int y = -selectionSize; y <= selectionSize; y++) {
-            for(int x = -selectionSize; x <= selectionSize; x++) {
-                if(x * x + y * y < selectionSize * selectionSize) {
-                    int grid_x = (mousex + x * gridSpacing) / gridSpacing;
-                    int grid_y = (mousey + y * gridSpacing) / gridSpacing;
-                    if(grid_x >= 0 && grid_x < Grid::width && grid_y >= 0 && grid_y < Grid::height) {
-                        Particle particle = ParticleFactory::createParticle(selectedParticle);
-                        // particle.hasChanged = true;
-                        Grid::setParticle(grid_x, grid_y, particle);
-                    }
-                }
-            }
-        }
-    } else if(currentAction == ActionState::REMOVE) {
-        // Remove particles in a circle
-        for(int y = -selectionSize; y <= selectionSize; y++) {
-            for(int x = -selectionSize; x <= selectionSize; x++) {
-                if(x * x + y * y < selectionSize * selectionSize) {
-                    int grid_x = (mouse_pos.first + x * gridSpacing) / gridSpacing;
-                    int grid_y = (mouse_pos.second + y * gridSpacing) / gridSpacing;
-                    if(grid_x >= 0 && grid_x < Grid::width && grid_y >= 0 && grid_y < Grid::height) {
-                        Grid::removeParticle(grid_x, grid_y);
-                    }
-                }
-            }
-        }
-    }
-
-    // reset particles for this round of processing
-    for(int y = 0; y < Grid::height; y++) {
-        for(int x = 0; x < Grid::width; x++) {
-            Particle& particle = Grid::getParticle(x, y);
-            particle.onTick();
-        }
-    }
-    
-
-    Grid::processParticles();
-}
-
 /* This function runs when a new event (mouse input, keypresses, etc) occurs. */
 SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event){
     if (event->type == SDL_EVENT_QUIT) {
@@ -143,22 +174,34 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event){
             // printf("Selected particle: WATER\n");
         } else if(event->key.key == SDLK_D){
             is_debug = !is_debug;
+            simulation.setDebugInfo(is_debug);
+        } else if(event->key.key == SDLK_LEFT){
+            moveCamera(-1, 0);
+        } else if(event->key.key == SDLK_RIGHT){
+            moveCamera(1, 0);
+        } else if(event->key.key == SDLK_UP){
+            moveCamera(0, -1);
+        } else if(event->key.key == SDLK_DOWN){
+            moveCamera(0, 1);
         }
+        sendBrush();
 
     } else if (event->type == SDL_EVENT_MOUSE_MOTION) {
 
         mouse_pos.first = static_cast<int>(event->motion.x);
         mouse_pos.second = static_cast<int>(event->motion.y);
+        sendBrush();
 
     } else if (event->type == SDL_EVENT_MOUSE_BUTTON_DOWN) {
         // printf("Mouse button pressed: %d at (%d, %d)\n", event->button.button, event->button.x, event->button.y);
         if(event->button.button == SDL_BUTTON_LEFT) {
-            currentAction = ActionState::PLACE;
+            currentAction = BrushAction::PLACE;
 
         }else if(event->button.button == SDL_BUTTON_RIGHT) {
-            currentAction = ActionState::REMOVE;
+            currentAction = BrushAction::REMOVE;
 
         }
+        sendBrush();
 
     } else if (event->type == SDL_EVENT_MOUSE_WHEEL) {
         // printf("Mouse wheel scrolled: (%.2f, %.2f)\n", event->wheel.x, event->wheel.y);
@@ -169,8 +212,10 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event){
         } else if(scroll < 0) {
             selectionSize = std::max(selectionSize - 1, 5);
         }
+        sendBrush();
     } else if (event->type == SDL_EVENT_MOUSE_BUTTON_UP){
-        currentAction = ActionState::NONE;
+        currentAction = BrushAction::NONE;
+        sendBrush();
     }
 
     return SDL_APP_CONTINUE;  /* carry on with the program! */
@@ -191,156 +236,83 @@ void drawCircle(int x, int y, int r, int thickness = 1){
     }
 }
 
-void renderGrid(){
-
-    for(auto& chunk : Grid::particleChunks) {
-        if(chunk.texture == nullptr) {
-            chunk.texture = SDL_CreateTexture(renderer,
-                SDL_PIXELFORMAT_RGBA8888,
-                SDL_TEXTUREACCESS_TARGET,
-                ParticleChunk::CHUNK_SIZE * gridSpacing,
-                ParticleChunk::CHUNK_SIZE * gridSpacing);
-            SDL_SetRenderTarget(renderer, chunk.texture);
-            SDL_SetRenderDrawColorFloat(renderer, 0.0f, 0.0f, 0.0f, 0.0f);
-            SDL_RenderClear(renderer);
-            SDL_SetRenderTarget(renderer, nullptr);
-        }
-
-        if(chunk.dirty || is_debug){
-
-            SDL_SetRenderTarget(renderer, chunk.texture);
-
-            // Clear the chunk texture with transparent background
-            SDL_SetRenderDrawColorFloat(renderer, 0.0f, 0.0f, 0.0f, 0.0f);
-            SDL_RenderClear(renderer);
-
-            for(int y = 0; y < ParticleChunk::CHUNK_SIZE; y++) {
-                for(int x = 0; x < ParticleChunk::CHUNK_SIZE; x++) {
-                    // Calculate actual grid coordinates
-                    int grid_x = chunk.x * ParticleChunk::CHUNK_SIZE + x;
-                    int grid_y = chunk.y * ParticleChunk::CHUNK_SIZE + y;
-                    
-                    // Skip if outside grid bounds
-                    if(grid_x >= Grid::width || grid_y >= Grid::height) continue;
-                    
-                    Particle& particle = Grid::getParticle(grid_x, grid_y);
-                    if(particle.type_id == ParticleTypeID::EMPTY) continue;
-
-                    // Set color for this particle
-                    Color color;
-                    if(is_debug) {
-                        if(particle.hasChanged && particle.received_update) {
-                            color = Color(0, 255, 0);  // Debug color for changed particles
-                        }else if(particle.hasChanged && !particle.received_update){
-                            color = Color(255, 0, 0);  // Debug color for unchanged particles
-                        }else if(!particle.hasChanged && particle.received_update){
-                            color = Color(0, 0, 255);  // Debug color for unchanged particles
-                        }else{
-                            color = Color(128,128,128);
-                        }
-                    } else {
-                        color = particle.getColor();
-                    }
-                    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, SDL_ALPHA_OPAQUE);
-
-                    // Render relative to chunk texture (0,0 to CHUNK_SIZE,CHUNK_SIZE)
-                    SDL_FRect rect = {
-                        .x = static_cast<float>(x * gridSpacing),
-                        .y = static_cast<float>(y * gridSpacing),
-                        .w = static_cast<float>(gridSpacing),
-                        .h = static_cast<float>(gridSpacing)
-                    };
-                    SDL_RenderFillRect(renderer, &rect);
-                }
-            }
-
-            chunk.dirty = false;  // Reset dirty flag after rendering
-
-
-            if(is_debug && chunk.shouldProcess){
-                SDL_SetRenderDrawColor(renderer, 255, 0, 0, SDL_ALPHA_OPAQUE);
-
-                SDL_FRect thisRect = {
-                    .x = 0,
-                    .y = 0,
-                    .w = (float)(ParticleChunk::CHUNK_SIZE * gridSpacing),
-                    .h = (float)(ParticleChunk::CHUNK_SIZE * gridSpacing)
-                };
-
-                SDL_RenderRect(renderer, &thisRect);
-            }
-
-
-            SDL_SetRenderTarget(renderer, nullptr);
-        }
-
-        SDL_FRect chunk_rect = {
-            .x = static_cast<float>(chunk.x * ParticleChunk::CHUNK_SIZE * gridSpacing),
-            .y = static_cast<float>(chunk.y * ParticleChunk::CHUNK_SIZE * gridSpacing),
-            .w = static_cast<float>(ParticleChunk::CHUNK_SIZE * gridSpacing),
-            .h = static_cast<float>(ParticleChunk::CHUNK_SIZE * gridSpacing)
-        };
-
-        if(chunk.texture)
-            SDL_RenderTexture(renderer, chunk.texture, nullptr, &chunk_rect);
-    }
+// Timings on top of the grid while debugging, per tick averages of the last ticks
+static void drawProfileOverlay(){
+    const FrameProfile& profile = overlay_profile;
+    const TickStats& stats = profile.last.stats;
+    const GridRenderer::RenderStats& render_stats = GridRenderer::getLastStats();
+    double ticks = std::max(profile.ticks, 1);
+    auto ms = [ticks](uint64_t ns) { return ns / ticks / 1e6; };
+
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
+    SDL_FRect background = {.x = 4.0f, .y = 4.0f, .w = 660.0f, .h = 48.0f};
+    SDL_RenderFillRect(renderer, &background);
+
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
+    SDL_RenderDebugTextFormat(renderer, 8.0f, 8.0f, "tick %llu  ticks/frame %d", static_cast<unsigned long long>(profile.last.tick), profile.ticks);
+    SDL_RenderDebugTextFormat(renderer, 8.0f, 18.0f, "ms brush %.3f  stamp %.3f  activate %.3f  sweep %.3f  react %.3f  level %.3f  publish %.3f",
+        ms(profile.brush_ns), ms(profile.stamp_ns), ms(profile.activate_ns), ms(profile.sweep_ns), ms(profile.react_ns), ms(profile.level_ns),
+        ms(profile.publish_ns));
+    SDL_RenderDebugTextFormat(renderer, 8.0f, 28.0f, "swaps %.0f  reacted %.0f  levelled %.0f  chunks active %d  allocated %d  published %.1f",
+        profile.swaps / ticks, profile.reacted / ticks, profile.levelled / ticks, stats.active_chunks, stats.allocated_chunks, profile.published_chunks / ticks);
+    SDL_RenderDebugTextFormat(renderer, 8.0f, 38.0f, "ms render %.3f  present %.3f  redrawn chunks %d",
+        render_stats.render_ns / 1e6, present_ns / 1e6, render_stats.redrawn_chunks);
 }
 
 /* This function runs once per frame, and is the heart of the program. */
 SDL_AppResult SDL_AppIterate(void *appstate){
-    static Uint64 last_time = SDL_GetTicks();
-    static int tick_counter = 0;
-    static int tick_interval = 10;  // Time in ms between ticks
-    static int frames = 0;
-    Uint64 now = SDL_GetTicks();
-
-    int dt = now - last_time;
-    // int target_time = 1000/60;
-
-    int max_frame_time = 1000 / 60;  // Maximum frame time for 60 FPS
-
-    frames++;
-
-    tick_counter += dt;
-
-    
-    //stop ticking if it's taking too long to presere frame rate
-    // printf("Ticking...\n");
-    while(tick_counter >= tick_interval && SDL_GetTicks() - now < max_frame_time) {
-        
-        tick_counter -= tick_interval;
-        
-        onTick();
-        
-        
+    // the simulation ticks on its own thread, just draw its newest frame
+    const FrameSnapshot& frame = simulation.acquireFrame();
+    flushBrushes();
+
+    FrameProfile profile;
+    TickProfile tick_profile;
+    while(simulation.popTickProfile(tick_profile)) {
+        profile.ticks++;
+        profile.last = tick_profile;
+        profile.brush_ns += tick_profile.brush_ns;
+        profile.stamp_ns += tick_profile.stats.stamp_ns;
+        profile.activate_ns += tick_profile.stats.activate_ns;
+        profile.sweep_ns += tick_profile.stats.sweep_ns;
+        profile.react_ns += tick_profile.stats.react_ns;
+        profile.level_ns += tick_profile.stats.level_ns;
+        profile.publish_ns += tick_profile.publish_ns;
+        profile.swaps += tick_profile.stats.swaps;
+        profile.reacted += tick_profile.stats.reacted;
+        profile.levelled += tick_profile.stats.levelled;
+        profile.published_chunks += tick_profile.published_chunks;
+    }
+    if(profile.ticks > 0) {
+        overlay_profile = profile;
     }
-    // printf("done ticking...\n");
 
-    last_time = now;
-    
-    
     //clear the window.
     SDL_SetRenderDrawColorFloat(renderer, 0.1f, 0.1f, 0.1f, SDL_ALPHA_OPAQUE_FLOAT);
     SDL_RenderClear(renderer);
 
-    {
-        Uint64 t0 = SDL_GetTicks();
-
-        // printf("rendering...\n");
-        renderGrid();
-        // printf("done rendering...\n");
-
-        Uint64 t1 = SDL_GetTicks();
-
-        // printf("Render took %llu ms\n", t1 - t0);
-    }
+    // times itself, see GridRenderer::getLastStats()
+    GridRenderer::render(renderer, frame, gridSpacing, is_debug);
 
     //render UI
     SDL_SetRenderDrawColor(renderer, 128, 0, 0, 128);
     drawCircle(mouse_pos.first, mouse_pos.second, selectionSize * gridSpacing, 2);
+    if(is_debug) {
+        drawProfileOverlay();
+    }
 
     /* put the newly-cleared rendering on the screen. */
+    uint64_t present_start = Profiler::now();
     SDL_RenderPresent(renderer);
+    present_ns = Profiler::now() - present_start;
+
+    const GridRenderer::RenderStats& render_stats = GridRenderer::getLastStats();
+    profile_log.write({static_cast<double>(frame_count), static_cast<double>(frame.tick), static_cast<double>(profile.ticks),
+        profile.brush_ns / 1e3, profile.stamp_ns / 1e3, profile.activate_ns / 1e3, profile.sweep_ns / 1e3, profile.react_ns / 1e3,
+        profile.level_ns / 1e3, profile.publish_ns / 1e3, static_cast<double>(profile.swaps), static_cast<double>(profile.reacted),
+        static_cast<double>(profile.levelled), static_cast<double>(profile.last.stats.active_chunks),
+        static_cast<double>(profile.last.stats.allocated_chunks), static_cast<double>(profile.published_chunks),
+        render_stats.render_ns / 1e3, static_cast<double>(render_stats.redrawn_chunks), present_ns / 1e3});
+    frame_count++;
 
     return SDL_APP_CONTINUE;  /* carry on with the program! */
 }
@@ -348,6 +320,9 @@ SDL_AppResult SDL_AppIterate(void *appstate){
 /* This function runs once at shutdown. */
 void SDL_AppQuit(void *appstate, SDL_AppResult result){
     /* SDL will clean up the window/renderer for us. */
-    // Grid::stopThreadedProcessing();
+    simulation.stop();
+    GridRenderer::cleanup();
+    profile_log.close();
+
     Grid::cleanup();  // Cleanup grid and particles
 }
\ No newline at end of file
@@ -1,226 +1,175 @@
 #include "particles/Particle.h"
 #include "particles/ParticleBehavior.h"
 #include "particles/ParticleType.h"
-#include "particles/ParticleFactory.h"
 #include "structures/Grid.h"
-#include <random>
-
+#include "util/Random.h"
+
+
+void Behaviors::update(ParticleTypeID type, int x, int y) {
+    static_assert(NUM_PARTICLE_TYPES == 5, "add the new material to the switch below");
+
+    switch(type) {
+        case ParticleTypeID::SAND:
+            MaterialBehaviors<ParticleTypeID::SAND>::Pipeline::run(x, y);
+            break;
+        case ParticleTypeID::WATER:
+            MaterialBehaviors<ParticleTypeID::WATER>::Pipeline::run(x, y);
+            break;
+        case ParticleTypeID::WET_SAND:
+            MaterialBehaviors<ParticleTypeID::WET_SAND>::Pipeline::run(x, y);
+            break;
+        case ParticleTypeID::EMPTY:
+        case ParticleTypeID::STONE:
+        default:
+            break;
+    }
+}
 
-void Behaviors::gravity(Particle& particle) {
-    if(particle.hasChanged) return;
+void Behaviors::gravity(int x, int y) {
+    if(Grid::hasChanged(x, y)) return;
 
-    if(!Grid::isInBounds(particle.x, particle.y + 1)) return;  // Check bounds
-    Particle& below = Grid::getParticle(particle.x, particle.y + 1);
+    if(!Grid::isInBounds(x, y + 1)) return;  // Check bounds
+    ParticleTypeID below = Grid::getType(x, y + 1);
 
-    if(below.type_id == ParticleTypeID::EMPTY){
-        Grid::swapParticles(particle.x, particle.y, particle.x, particle.y + 1);
-    }else if(below.state != MatterState::SOLID) {
-        if(particle.density > below.density) {
-            Grid::swapParticles(particle.x, particle.y, particle.x, particle.y + 1);
+    if(below == ParticleTypeID::EMPTY){
+        Grid::swapParticles(x, y, x, y + 1);
+    }else if(ParticleTypeRegistry::getState(below) != MatterState::SOLID) {
+        if(ParticleTypeRegistry::getDensity(Grid::getType(x, y)) > ParticleTypeRegistry::getDensity(below)) {
+            Grid::swapParticles(x, y, x, y + 1);
         }
     }
 }
 
-void Behaviors::spread(Particle& particle, float min_slope) {
-    if(particle.hasChanged) return;
+// Solid bit of the cell dx columns from the middle of a Grid::getSolidRow() window
+static inline bool isSolidAt(uint32_t row, int dx) {
+    return (row >> (Grid::SOLID_ROW_CENTER + dx)) & 1;
+}
+
+void Behaviors::spread(int x, int y, int min_slope) {
+    if(Grid::hasChanged(x, y)) return;
 
     int max_dx = 3;
     int max_dy = 3;
 
-    if(min_slope <= 0.1f){
+    if(min_slope <= 10){
         max_dx = 8;
-    }else if(min_slope <= 0.2f){
+    }else if(min_slope <= 20){
         max_dx = 6;
-    }else if(min_slope <= 0.5f){
+    }else if(min_slope <= 50){
         max_dx = 4;
     }
 
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<int> dist(0, 1);
+    // the rows the search can reach as bits, a buried grain stops after the first
+    uint32_t rows[5];
+    rows[0] = Grid::getSolidRow(x, y);
+    if(isSolidAt(rows[0], -1) && isSolidAt(rows[0], 1)) return;
+    for(int dy = 1; dy <= max_dy + 1; dy++) {
+        rows[dy] = Grid::getSolidRow(x, y + dy);
+    }
+
+    Random::CellRandom rng = Grid::random(x, y, Random::STREAM_SPREAD);
 
-    int best_dx = 0, best_dy = 0;
-    float best_slope = 0.0f;
+    // slopes are compared as dy / |dx| fractions
+    int best_dx = 0, best_dy = 0, best_run = 1;
 
     for(int i = 0; i <= 1; i++){
-        int dx = i ? 1 : -1;
         int dir = i ? 1 : -1;
+        int dx = dir;
         int dy = 0;
 
-        while(abs(dx) <= max_dx && abs(dy) <= max_dy) {
-            if(Grid::isCellNonSolid(particle.x + dx, particle.y + dy)){
-                float current_slope = static_cast<float>(dy) / dx;
-                if(current_slope < 0) current_slope = -current_slope;
-
-                if(current_slope >= min_slope){
-                    if ((current_slope > best_slope) || (current_slope == best_slope && dist(gen))) {
-                        best_slope = current_slope;
-                        best_dx = dx;
-                        best_dy = dy;
-                    }
-                }
+        while(abs(dx) <= max_dx && dy <= max_dy) {
+            if(isSolidAt(rows[dy], dx)) break;
 
-                if(Grid::isCellNonSolid(particle.x + dx, particle.y + dy+1)){
-                    dy++;
-                }else{
-                    dx += dir;
+            int run = abs(dx);
+            if(dy * 100 >= min_slope * run){
+                int steeper = dy * best_run - best_dy * run;
+                if(steeper > 0 || (steeper == 0 && rng.nextBool())) {
+                    best_dx = dx;
+                    best_dy = dy;
+                    best_run = run;
                 }
+            }
+
+            if(!isSolidAt(rows[dy + 1], dx)){
+                dy++;
+                continue;
+            }
+
+            // along flat ground the slope only gets shallower, skip to the
+            // next cell that is solid or has a drop below it
+            uint32_t stops = rows[dy] | ~rows[dy + 1];
+            int at = Grid::SOLID_ROW_CENTER + dx;
+            if(dir > 0){
+                uint32_t ahead = stops >> (at + 1);
+                if(ahead == 0) break;
+                dx += 1 + __builtin_ctz(ahead);
             }else{
-                break;
+                uint32_t ahead = stops << (32 - at);
+                if(ahead == 0) break;
+                dx -= 1 + __builtin_clz(ahead);
             }
         }
     }
 
-    if (best_slope >= min_slope && best_dx != 0) {
+    if(best_dx != 0) {
         int dx = best_dx > 0 ? 1 : -1;
-        int dy = 0;
-
-        if(Grid::isCellNonSolid(particle.x + dx, particle.y + 1)){
-            dy = 1;
-        }
+        int dy = isSolidAt(rows[1], dx) ? 0 : 1;
 
-        Grid::swapParticles(particle.x, particle.y, particle.x + dx, particle.y + dy);
+        Grid::swapParticles(x, y, x + dx, y + dy);
     }
 }
 
-void Behaviors::spreadLiquid(Particle& particle){
-    if(particle.hasChanged) return;
+void Behaviors::spreadLiquid(int x, int y){
+    if(Grid::hasChanged(x, y)) return;
 
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<int> dist(0, 1);
+    Random::CellRandom rng = Grid::random(x, y, Random::STREAM_SPREAD_LIQUID);
 
-    int r = dist(gen);
+    int r = rng.nextBool();
+
+    // with levelling on, a surface cell with nothing lower to flow into is
+    // already level and stays put, moving it only churns the surface. liquid
+    // above still pushes a cell sideways
+    bool settles = Grid::isLiquidLevelling() && !(y > 0 && Grid::getState(x, y - 1) == MatterState::LIQUID);
 
     int min_dx = 0;
     int max_dx = 0;
 
     for(int i = 0; i <= 1; i++){
         int dir = (i != r) ? 1 : -1;
+        int side_dx = 0;
+        bool drops = false;
         for(int j = 1; j <= 3; j++){
             int dx = dir*j;
-            if(Grid::isInBounds(particle.x + dx, particle.y) && Grid::isCellEmpty(particle.x + dx, particle.y)) {
-                if(dx > 0){
-                    max_dx = dx;
-                }else{
-                    min_dx = dx;
-                }
+            if(Grid::isInBounds(x + dx, y) && Grid::isCellEmpty(x + dx, y)) {
+                side_dx = dx;
+                drops = Grid::isCellEmpty(x + dx, y + 1);
+                if(settles && drops) break;  // stop over the first drop
             }else{
                 break;  // Stop if we hit a non-empty cell
             }
         }
+        if(settles && !drops) {
+            side_dx = 0;  // flat all the way
+        }
+        if(side_dx > 0){
+            max_dx = side_dx;
+        }else if(side_dx < 0){
+            min_dx = side_dx;
+        }
     }
+    // nowhere to go, don't swap with itself or the cell never settles
+    if(max_dx == 0 && min_dx == 0) return;
+
     if(max_dx > -min_dx){
-        Grid::swapParticles(particle.x, particle.y, particle.x + max_dx, particle.y);
+        Grid::swapParticles(x, y, x + max_dx, y);
     }else if(max_dx < -min_dx){
-        Grid::swapParticles(particle.x, particle.y, particle.x + min_dx, particle.y);
+        Grid::swapParticles(x, y, x + min_dx, y);
     }else{
-        if(dist(gen)){
-            Grid::swapParticles(particle.x, particle.y, particle.x + max_dx, particle.y);
+        if(rng.nextBool()){
+            Grid::swapParticles(x, y, x + max_dx, y);
         }else{
-            Grid::swapParticles(particle.x, particle.y, particle.x + min_dx, particle.y);
+            Grid::swapParticles(x, y, x + min_dx, y);
         }
     }
     
 }
-
-
-//sand touching water
-void Behaviors::absorb(Particle& particle) {
-    if(particle.hasChanged) return;
-
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<int> dist(1,10);
-
-    if(!Grid::isParticleNearType(particle.x, particle.y, ParticleTypeID::WATER, 1, 1)) {
-        // Check all neighbors for water
-        return;
-    }
-
-    for(int dx = -1; dx <= 1; dx++) {
-        for(int dy = -1; dy <= 1; dy++) {
-            if(dx == 0 && dy == 0) continue;  // Skip self
-
-            // Random chance to skip some checks
-            if(dist(gen) <= 2) {
-                continue;
-            }
-            if(!Grid::isInBounds(particle.x + dx, particle.y + dy)) continue;  // Check bounds
-            Particle& neighbor = Grid::getParticle(particle.x + dx, particle.y + dy);
-            if(neighbor.type_id == ParticleTypeID::WATER) {
-
-                bool flag = false;
-
-                if(particle.type_id == ParticleTypeID::WET_SAND) {
-                    // If it's wet sand, absorb more moisture
-                    uint8_t current_moisture = particle.data.wet_sand.moisture;
-                    // printf("detected moisture: %d\n", current_moisture);
-                    if(current_moisture <= 15){
-                        particle.data.wet_sand.moisture += 8;
-                        // printf("absorbing water. Moisture was %d, now: %d\n", current_moisture, particle.getData<int>("moisture", 1));
-                        flag = true;
-                    }
-                } else {
-                    // Otherwise, turn it into wet sand
-                    Particle wet_sand = ParticleFactory::createParticle(ParticleTypeID::WET_SAND);
-                    wet_sand.x = particle.x;
-                    wet_sand.y = particle.y;
-
-                    particle = wet_sand;
-
-                    flag = true;
-                }
-
-                if(flag){
-                    Grid::removeParticle(particle.x + dx, particle.y + dy);
-                    particle.hasChanged = true;
-                    Grid::onParticleUpdate(particle.x, particle.y);
-                    return;
-                }
-            }
-        }
-    }
-}
-
-void Behaviors::spreadWetSand(Particle& particle) {
-    if(particle.hasChanged) return;
-
-
-    int dx_arr[] = {-1, -1, -1, 0, 0, 1, 1, 1};
-    int dy_arr[] = {-1,  0,  1, -1,1,-1, 0, 1};
-
-    for(int i = 0; i < 8; i++) {
-        int dx = dx_arr[i];
-        int dy = dy_arr[i];
-
-        if(!Grid::isInBounds(particle.x + dx, particle.y + dy)) continue;
-
-        Particle& neighbor = Grid::getParticle(particle.x + dx, particle.y + dy);
-        if(neighbor.type_id == ParticleTypeID::SAND) {
-            uint8_t current_moisture = particle.data.wet_sand.moisture;
-
-            if(current_moisture >= 2) {
-                particle.data.wet_sand.moisture -= 1;
-                particle.hasChanged = true;
-                Grid::onParticleUpdate(particle.x, particle.y);
-                Grid::setParticle(particle.x + dx, particle.y + dy, ParticleFactory::createParticle(ParticleTypeID::WET_SAND));
-                return;
-            }
-        }else if(neighbor.type_id == ParticleTypeID::WET_SAND){
-            uint8_t neighbor_moisture = neighbor.data.wet_sand.moisture;
-            uint8_t current_moisture = particle.data.wet_sand.moisture;
-
-            if(current_moisture >= 2 && current_moisture - neighbor_moisture > 1 ) {
-                particle.data.wet_sand.moisture -= 1;
-                neighbor.data.wet_sand.moisture += 1;
-                particle.hasChanged = true;
-                neighbor.hasChanged = true;
-                Grid::onParticleUpdate(particle.x, particle.y);
-                Grid::onParticleUpdate(neighbor.x, neighbor.y);
-                return;
-            }
-        }
-    }
-}
-
@@ -1,17 +1,94 @@
-#include <functional>
+#include <array>
+#include <utility>
+#include "particles/ParticleType.h"
 
 #ifndef PARTICLE_BEHAVIOR_H
 #define PARTICLE_BEHAVIOR_H
 
-// Forward declaration to avoid circular include
-class Particle;
-
+// Behaviors act on the particle stored at grid position (x, y)
 namespace Behaviors{
-    void gravity(Particle& particle);
-    void spread(Particle& particle, float slope);
-    void spreadLiquid(Particle& particle);
-    void absorb(Particle& particle);
-    void spreadWetSand(Particle& particle);
+    void gravity(int x, int y);
+    // min_slope in hundredths of a cell down per cell across, above 0
+    void spread(int x, int y, int min_slope);
+    void spreadLiquid(int x, int y);
+
+    // Run the behavior pipeline of a material, see MaterialBehaviors below
+    void update(ParticleTypeID type, int x, int y);
+
+    // Pipeline steps, so behaviors can be listed as template arguments
+    struct Gravity { static inline void run(int x, int y) { gravity(x, y); } };
+    template<int MinSlopeHundredths>
+    struct Spread {
+        static_assert(MinSlopeHundredths > 0, "spread skips flat ground, it can't pick a flat spot");
+        static inline void run(int x, int y) { spread(x, y, MinSlopeHundredths); }
+    };
+    struct SpreadLiquid { static inline void run(int x, int y) { spreadLiquid(x, y); } };
 }
 
-#endif // PARTICLE_BEHAVIOR_H
\ No newline at end of file
+// Steps run in order, each one returns early once the particle has changed
+template<typename... Steps>
+struct BehaviorPipeline {
+    static constexpr bool is_static = sizeof...(Steps) == 0;
+
+    static inline void run(int x, int y) {
+        (Steps::run(x, y), ...);
+    }
+};
+
+// Behavior pipeline for each material, materials without one never move on their own.
+// What happens where two materials touch is in the reaction table, see Reaction.h
+template<ParticleTypeID ID>
+struct MaterialBehaviors {
+    using Pipeline = BehaviorPipeline<>;
+};
+
+template<>
+struct MaterialBehaviors<ParticleTypeID::SAND> {
+    using Pipeline = BehaviorPipeline<Behaviors::Gravity, Behaviors::Spread<60>>;
+};
+
+template<>
+struct MaterialBehaviors<ParticleTypeID::WET_SAND> {
+    using Pipeline = BehaviorPipeline<Behaviors::Gravity, Behaviors::Spread<200>>;
+};
+
+template<>
+struct MaterialBehaviors<ParticleTypeID::WATER> {
+    using Pipeline = BehaviorPipeline<Behaviors::Gravity, Behaviors::SpreadLiquid>;
+};
+
+template<size_t... Ids>
+constexpr std::array<bool, NUM_PARTICLE_TYPES> makeStaticMaterialTable(std::index_sequence<Ids...>) {
+    return {MaterialBehaviors<static_cast<ParticleTypeID>(Ids)>::Pipeline::is_static...};
+}
+
+inline constexpr std::array<bool, NUM_PARTICLE_TYPES> STATIC_MATERIALS =
+    makeStaticMaterialTable(std::make_index_sequence<NUM_PARTICLE_TYPES>{});
+
+// true for materials with no behaviors (EMPTY, STONE), the sweep skips them without a call
+constexpr bool isStaticMaterial(ParticleTypeID id) {
+    return STATIC_MATERIALS[static_cast<size_t>(id)];
+}
+
+// Spread's minimum slope for granular materials, the ones that only fall and
+// slide down slopes (Gravity then Spread), 0 for the rest. The bitboard
+// update moves these a chunk row at a time
+template<typename Pipeline>
+struct GranularSlope {
+    static constexpr int value = 0;
+};
+
+template<int MinSlopeHundredths>
+struct GranularSlope<BehaviorPipeline<Behaviors::Gravity, Behaviors::Spread<MinSlopeHundredths>>> {
+    static constexpr int value = MinSlopeHundredths;
+};
+
+template<size_t... Ids>
+constexpr std::array<int, NUM_PARTICLE_TYPES> makeGranularSlopeTable(std::index_sequence<Ids...>) {
+    return {GranularSlope<typename MaterialBehaviors<static_cast<ParticleTypeID>(Ids)>::Pipeline>::value...};
+}
+
+inline constexpr std::array<int, NUM_PARTICLE_TYPES> GRANULAR_MIN_SLOPE =
+    makeGranularSlopeTable(std::make_index_sequence<NUM_PARTICLE_TYPES>{});
+
+#endif // PARTICLE_BEHAVIOR_H
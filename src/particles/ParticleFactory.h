@@ -1,31 +1,24 @@
-#include <random>
 #include "particles/Particle.h"
 #include "particles/ParticleBehavior.h"
 #include "particles/ParticleType.h"
-#include "util/Color.h"
+#include "util/Random.h"
 
 
 #ifndef PARTICLE_FACTORY_H
 #define PARTICLE_FACTORY_H
 
 namespace ParticleFactory {
-    inline Particle createParticle(ParticleTypeID type_id) {
-        ParticleType& type = ParticleTypeRegistry::getType(type_id);
-        auto palette = type.color_palette.data();
-        auto size = type.color_palette.size();
-        auto weights = type.color_weights.data();
-        Color color = Color::fromSelection(palette, size, weights);
-        Particle particle = Particle(color, type_id);
-        particle.state = type.state;
-        particle.density = type.base_density;
-
-        // if(type_id == ParticleTypeID::SAND) {
-        //     printf("Creating particle of type %d with state %d\n", 
-        //       static_cast<int>(type_id), static_cast<int>(particle.state));
-        // }
-        
+    // Shade is picked from the given random bits, so the result is reproducible
+    inline Particle createParticle(ParticleTypeID type_id, uint64_t random_bits) {
+        const ParticleType& type = ParticleTypeRegistry::getType(type_id);
+        int shade = type.shade_table.sample(random_bits);
+        return Particle(type_id, static_cast<uint8_t>(shade));
+    }
 
-        return particle;
+    inline Particle createParticle(ParticleTypeID type_id) {
+        // per thread counter, only used where reproducibility doesn't matter
+        thread_local uint64_t counter = 0;
+        return createParticle(type_id, Random::mix64(++counter));
     }
 }
 
@@ -1,16 +1,14 @@
 #include <vector>
 #include "util/Color.h"
-#include "particles/ParticleBehavior.h"
-#include <functional>
+#include "util/AliasTable.h"
 #include <array>
+#include <algorithm>
+#include <cstdint>
 
 #ifndef PARTICLE_TYPE_H
 #define PARTICLE_TYPE_H
 
-//avoid importing recursion
-class Particle;
-
-enum ParticleTypeID {
+enum ParticleTypeID : uint8_t {
     EMPTY = 0,
     SAND = 1,
     WATER = 2,
@@ -18,7 +16,7 @@ enum ParticleTypeID {
     WET_SAND = 4,
 };
 
-enum MatterState{
+enum MatterState : uint8_t {
     NONE,
     SOLID,
     LIQUID,
@@ -30,24 +28,24 @@ const int NUM_PARTICLE_TYPES = 5;  // Update this if you add more particle types
 union ParticleTypeData {
     struct { uint8_t moisture; } wet_sand;      // 1 byte
     struct { uint32_t velocity;} water;
-    uint64_t raw;                               // 8 bytes
+    uint32_t raw;                               // 4 bytes
 };
 
 struct ParticleType {
-    float base_density;
+    float base_density = 0.0f;
     std::vector<Color> color_palette;
     std::vector<int> color_weights;
+    AliasTable shade_table;     // samples color_palette by color_weights
 
-    std::function<void(Particle&)> executeBehaviors;
-
-    MatterState state;
+    // behaviors are picked at compile time, see MaterialBehaviors in ParticleBehavior.h
+    MatterState state = MatterState::NONE;
 
-    ParticleType(){
-        executeBehaviors = [](Particle& p) {};
-    }
+    ParticleType() = default;
 
-    ParticleType(float density, MatterState state, std::vector<Color> colors, std::vector<int> weights, std::function<void(Particle&)> behaviors)
-        : base_density(density), color_palette(colors), color_weights(weights), executeBehaviors(behaviors), state(state) {}
+    ParticleType(float density, MatterState state, std::vector<Color> colors, std::vector<int> weights)
+        : base_density(density), color_palette(colors), color_weights(weights),
+          shade_table(color_weights.data(), static_cast<int>(std::min(color_palette.size(), color_weights.size()))),
+          state(state) {}
 };
 
 
@@ -55,10 +53,22 @@ struct ParticleType {
 class ParticleTypeRegistry {
     inline static std::array<ParticleType, NUM_PARTICLE_TYPES> types;
 
+    // compact copies of the per type fields read by neighbor checks
+    inline static std::array<MatterState, NUM_PARTICLE_TYPES> states{};
+    inline static std::array<float, NUM_PARTICLE_TYPES> densities{};
+
 public:
     static ParticleType& getType(ParticleTypeID id) {
         return types[static_cast<size_t>(id)];
     }
+
+    static inline MatterState getState(ParticleTypeID id) {
+        return states[static_cast<size_t>(id)];
+    }
+
+    static inline float getDensity(ParticleTypeID id) {
+        return densities[static_cast<size_t>(id)];
+    }
     
     inline static void initialize() {
         types[EMPTY] = ParticleType();
@@ -68,43 +78,28 @@ public:
             Color(204, 153, 0),
             Color(204, 102, 0),
             Color(153, 102, 51)},
-            {80, 10, 8, 2},
-            [](Particle& p) {
-                Behaviors::gravity(p);
-                Behaviors::spread(p, 0.6f);
-                // Behaviors::absorb(p);
-            });
-
-        // Wet Sand type
+            {80, 10, 8, 2});
+
+        // Wet Sand type, darker and browner than sand, moisture darkens it further
         types[WET_SAND] = ParticleType(1.8f, MatterState::SOLID,
-            {//Color(255, 204, 102),
-                Color(255,0,0),
-            Color(204, 153, 0),
-            Color(204, 102, 0),
-            Color(153, 102, 51)},
-            {80, 10, 8, 2},
-            [](Particle& p) {
-            Behaviors::gravity(p);
-            Behaviors::spread(p, 2.0f);
-            // Behaviors::absorb(p);
-            // Behaviors::spreadWetSand(p);
-            });
+            {Color(194, 150, 84),
+            Color(163, 118, 38),
+            Color(150, 88, 30),
+            Color(112, 78, 46)},
+            {80, 10, 8, 2});
 
         //Water type
         types[WATER] = ParticleType(1.0f, MatterState::LIQUID,
             {Color(51,51,255), Color(0,0,153), Color(0,51,204), Color(102,102,255)},
-            {80, 10, 8, 2},
-            [](Particle& p) {
-                
-                
-                Behaviors::gravity(p);
-                Behaviors::spreadLiquid(p);
-            });
+            {80, 10, 8, 2});
         
         // Stone type
-        types[STONE] = ParticleType(3.0f, MatterState::SOLID, {Color(128,128,128)}, {100},
-            [](Particle& p) {
-            });
+        types[STONE] = ParticleType(3.0f, MatterState::SOLID, {Color(128,128,128)}, {100});
+
+        for(int i = 0; i < NUM_PARTICLE_TYPES; i++) {
+            states[i] = types[i].state;
+            densities[i] = types[i].base_density;
+        }
     }
 };
 
@@ -0,0 +1,46 @@
+#include <array>
+#include <cstdint>
+#include "particles/ParticleType.h"
+
+#ifndef REACTION_H
+#define REACTION_H
+
+// What happens when a cell of one material touches a cell of another, see
+// Reactions.cpp for the pass that runs them. Moisture is wet sand's, a cell
+// that turns into wet sand starts dry and one that keeps its material keeps
+// its data.
+struct Reaction {
+    ParticleTypeID material, with;
+    ParticleTypeID becomes, with_becomes;
+    int8_t moisture, with_moisture;     // added to the cells that end up wet sand
+    uint8_t min_moisture, max_moisture; // the material's moisture it takes, inclusive
+    bool to_drier;                      // only with a neighbor 2 or more drier
+    uint8_t chance;                     // in 256ths, per tick
+};
+
+// wet sand this wet doesn't soak up any more water
+inline constexpr uint8_t SOAKED_MOISTURE = 16;
+
+// A cell only takes the first of its reactions that has a neighbor to react with
+inline constexpr Reaction REACTIONS[] = {
+    // sand soaks up the water it touches
+    {ParticleTypeID::SAND, ParticleTypeID::WATER, ParticleTypeID::WET_SAND, ParticleTypeID::EMPTY, 8, 0, 0, 255, false, 64},
+    {ParticleTypeID::WET_SAND, ParticleTypeID::WATER, ParticleTypeID::WET_SAND, ParticleTypeID::EMPTY, 8, 0, 0, SOAKED_MOISTURE - 1, false, 64},
+    // and passes it on to the sand around it
+    {ParticleTypeID::WET_SAND, ParticleTypeID::SAND, ParticleTypeID::WET_SAND, ParticleTypeID::WET_SAND, -1, 1, 2, 255, false, 32},
+    {ParticleTypeID::WET_SAND, ParticleTypeID::WET_SAND, ParticleTypeID::WET_SAND, ParticleTypeID::WET_SAND, -1, 1, 2, 255, true, 64},
+};
+
+// Per material, one bit for each material it reacts with, so whole chunks
+// whose materials can't react are skipped from their type_bitmask alone
+constexpr std::array<uint32_t, NUM_PARTICLE_TYPES> makeReactsWithTable() {
+    std::array<uint32_t, NUM_PARTICLE_TYPES> table{};
+    for(const Reaction& reaction : REACTIONS) {
+        table[reaction.material] |= 1u << reaction.with;
+    }
+    return table;
+}
+
+inline constexpr std::array<uint32_t, NUM_PARTICLE_TYPES> REACTS_WITH = makeReactsWithTable();
+
+#endif // REACTION_H
@@ -0,0 +1,183 @@
+#include "rendering/renderer.h"
+#include "structures/ParticleChunk.h"
+#include "particles/Particle.h"
+#include "particles/ParticleType.h"
+#include "util/Profiler.h"
+#include <vector>
+#include <array>
+#include <algorithm>
+
+static SDL_Texture* texture = nullptr;
+static int texture_width = 0;
+static int texture_height = 0;
+
+// one ABGR8888 pixel per cell, row major
+static std::vector<uint32_t> pixels;
+
+// palette colors packed once per type, indexed by shade
+static std::array<std::vector<uint32_t>, NUM_PARTICLE_TYPES> packed_palettes;
+
+// frame.chunk_versions of the chunks currently in the texture
+static std::vector<uint64_t> drawn_versions;
+
+static bool was_debug = false;
+
+static GridRenderer::RenderStats last_stats;
+
+static inline uint32_t packColor(const Color& color, uint8_t alpha = SDL_ALPHA_OPAQUE) {
+    return (static_cast<uint32_t>(alpha) << 24) | (static_cast<uint32_t>(color.b) << 16) |
+           (static_cast<uint32_t>(color.g) << 8) | color.r;
+}
+
+static void buildPalettes() {
+    for(int type = 0; type < NUM_PARTICLE_TYPES; type++) {
+        const ParticleType& particle_type = ParticleTypeRegistry::getType(static_cast<ParticleTypeID>(type));
+        packed_palettes[type].clear();
+        for(const Color& color : particle_type.color_palette) {
+            packed_palettes[type].push_back(packColor(color));
+        }
+    }
+}
+
+static inline uint32_t resolveColor(const FrameSnapshot& frame, int x, int y, bool is_debug) {
+    int i = frame.getIndex(x, y);
+    ParticleTypeID type = static_cast<ParticleTypeID>(frame.type_ids[i]);
+    if(type == ParticleTypeID::EMPTY) return 0;  // transparent, the background shows through
+
+    if(is_debug && !frame.debug_flags.empty()) {
+        bool hasChanged = frame.debug_flags[i] & FrameSnapshot::DEBUG_CHANGED;
+        bool received_update = frame.debug_flags[i] & FrameSnapshot::DEBUG_UPDATED;
+        if(hasChanged && received_update) {
+            return packColor(Color(0, 255, 0));  // Debug color for changed particles
+        }else if(hasChanged && !received_update){
+            return packColor(Color(255, 0, 0));  // Debug color for unchanged particles
+        }else if(!hasChanged && received_update){
+            return packColor(Color(0, 0, 255));  // Debug color for unchanged particles
+        }
+        return packColor(Color(128, 128, 128));
+    }
+
+    // moisture changes the shade, let Particle work it out
+    if(type == ParticleTypeID::WET_SAND) {
+        Particle particle(type, frame.shades[i]);
+        particle.data = frame.payloads[i];
+        return packColor(particle.getColor());
+    }
+
+    const std::vector<uint32_t>& palette = packed_palettes[type];
+    uint8_t shade = frame.shades[i];
+    return shade < palette.size() ? palette[shade] : packColor(Color(0, 0, 0));
+}
+
+static bool ensureTexture(SDL_Renderer* renderer, const FrameSnapshot& frame) {
+    if(texture != nullptr && texture_width == frame.width && texture_height == frame.height &&
+        drawn_versions.size() == frame.chunk_versions.size()) {
+        return true;
+    }
+
+    GridRenderer::cleanup();
+
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, frame.width, frame.height);
+    if(texture == nullptr) {
+        SDL_Log("Couldn't create grid texture: %s", SDL_GetError());
+        return false;
+    }
+    SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST);
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+
+    texture_width = frame.width;
+    texture_height = frame.height;
+    pixels.assign(static_cast<size_t>(texture_width) * texture_height, 0);
+    buildPalettes();
+
+    // versions start at 1, so everything is uploaded once
+    drawn_versions.assign(frame.chunk_versions.size(), 0);
+    return true;
+}
+
+// Resolve the cells of chunks [first, last] in one chunk row and upload them as one rect
+static void uploadChunkRun(const FrameSnapshot& frame, int chunk_y, int first, int last, bool is_debug) {
+    int x0 = first * ParticleChunk::CHUNK_SIZE;
+    int y0 = chunk_y * ParticleChunk::CHUNK_SIZE;
+    int x1 = std::min((last + 1) * ParticleChunk::CHUNK_SIZE, frame.width);
+    int y1 = std::min(y0 + ParticleChunk::CHUNK_SIZE, frame.height);
+
+    for(int y = y0; y < y1; y++) {
+        uint32_t* row = pixels.data() + static_cast<size_t>(y) * texture_width;
+        for(int x = x0; x < x1; x++) {
+            row[x] = resolveColor(frame, x, y, is_debug);
+        }
+    }
+
+    SDL_Rect rect = {x0, y0, x1 - x0, y1 - y0};
+    const uint32_t* start = pixels.data() + static_cast<size_t>(y0) * texture_width + x0;
+    SDL_UpdateTexture(texture, &rect, start, texture_width * static_cast<int>(sizeof(uint32_t)));
+}
+
+void GridRenderer::render(SDL_Renderer* renderer, const FrameSnapshot& frame, int cell_size, bool is_debug) {
+    last_stats = RenderStats();
+    ScopedTimer timer(last_stats.render_ns);
+    if(frame.width == 0 || !ensureTexture(renderer, frame)) return;
+
+    // debug colors follow the per tick flags, so everything is redrawn while
+    // debugging and once more when leaving it
+    bool redraw_all = is_debug || was_debug;
+    was_debug = is_debug;
+
+    for(int chunk_y = 0; chunk_y < frame.chunks_y; chunk_y++) {
+        int run_start = -1;
+        for(int chunk_x = 0; chunk_x <= frame.chunks_x; chunk_x++) {
+            bool dirty = false;
+            if(chunk_x < frame.chunks_x) {
+                int index = chunk_y * frame.chunks_x + chunk_x;
+                dirty = frame.chunk_versions[index] != drawn_versions[index] || redraw_all;
+                drawn_versions[index] = frame.chunk_versions[index];
+                if(dirty) last_stats.redrawn_chunks++;
+            }
+
+            if(dirty && run_start < 0) {
+                run_start = chunk_x;
+            }else if(!dirty && run_start >= 0) {
+                uploadChunkRun(frame, chunk_y, run_start, chunk_x - 1, is_debug);
+                run_start = -1;
+            }
+        }
+    }
+
+    SDL_FRect grid_rect = {
+        .x = 0.0f,
+        .y = 0.0f,
+        .w = static_cast<float>(texture_width * cell_size),
+        .h = static_cast<float>(texture_height * cell_size)
+    };
+    SDL_RenderTexture(renderer, texture, nullptr, &grid_rect);
+
+    if(is_debug) {
+        // outline the part of each chunk that was simulated this tick
+        SDL_SetRenderDrawColor(renderer, 255, 0, 0, SDL_ALPHA_OPAQUE);
+        for(const DirtyRect& active : frame.active_rects) {
+            SDL_FRect rect = {
+                .x = static_cast<float>(active.min_x * cell_size),
+                .y = static_cast<float>(active.min_y * cell_size),
+                .w = static_cast<float>((active.max_x - active.min_x + 1) * cell_size),
+                .h = static_cast<float>((active.max_y - active.min_y + 1) * cell_size)
+            };
+            SDL_RenderRect(renderer, &rect);
+        }
+    }
+}
+
+const GridRenderer::RenderStats& GridRenderer::getLastStats() {
+    return last_stats;
+}
+
+void GridRenderer::cleanup() {
+    if(texture != nullptr) {
+        SDL_DestroyTexture(texture);
+        texture = nullptr;
+    }
+    texture_width = 0;
+    texture_height = 0;
+    pixels.clear();
+    drawn_versions.clear();
+}
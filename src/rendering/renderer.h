@@ -0,0 +1,24 @@
+#include <SDL3/SDL.h>
+#include "structures/SimulationThread.h"
+
+#ifndef RENDERER_H
+#define RENDERER_H
+
+// Draws a published frame of the Grid through one streaming texture with a
+// pixel per cell. Only chunks that changed since the last drawn frame are
+// resolved into the CPU pixel buffer and uploaded, then the whole grid is
+// drawn in a single scaled blit.
+namespace GridRenderer {
+    // Counters for the last render() call
+    struct RenderStats {
+        uint64_t render_ns = 0;     // resolving, uploading and drawing the grid
+        int redrawn_chunks = 0;     // chunks resolved and uploaded again
+    };
+
+    void render(SDL_Renderer* renderer, const FrameSnapshot& frame, int cell_size, bool is_debug);
+    const RenderStats& getLastStats();
+
+    void cleanup();
+}
+
+#endif // RENDERER_H
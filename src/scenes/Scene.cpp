@@ -0,0 +1,162 @@
+#include "scenes/Scene.h"
+#include "structures/Grid.h"
+#include "particles/ParticleFactory.h"
+#include "particles/Reaction.h"
+#include <fstream>
+#include <random>
+#include <algorithm>
+
+
+static void fillRect(std::mt19937_64& gen, int x0, int y0, int x1, int y1, ParticleTypeID type) {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, Grid::width);
+    y1 = std::min(y1, Grid::height);
+
+    for(int y = y0; y < y1; y++) {
+        for(int x = x0; x < x1; x++) {
+            Grid::setParticle(x, y, ParticleFactory::createParticle(type, gen()));
+        }
+    }
+}
+
+// a loose block of sand in the upper half that collapses into a pile
+static void generateSand(std::mt19937_64& gen) {
+    std::uniform_int_distribution<int> chance(0, 9);
+
+    for(int y = 0; y < Grid::height / 2; y++) {
+        for(int x = Grid::width / 8; x < Grid::width - Grid::width / 8; x++) {
+            if(chance(gen) < 7) {
+                Grid::setParticle(x, y, ParticleFactory::createParticle(ParticleTypeID::SAND, gen()));
+            }
+        }
+    }
+}
+
+static int tankWallThickness() {
+    return std::max(Grid::width / 40, 1);
+}
+
+// an empty stone tank, open at the top
+static void generateTank(std::mt19937_64& gen) {
+    int wall = tankWallThickness();
+
+    fillRect(gen, 0, Grid::height - wall, Grid::width, Grid::height, ParticleTypeID::STONE);
+    fillRect(gen, 0, Grid::height / 4, wall, Grid::height, ParticleTypeID::STONE);
+    fillRect(gen, Grid::width - wall, Grid::height / 4, Grid::width, Grid::height, ParticleTypeID::STONE);
+}
+
+// a stone tank with a column of water dropped into one side
+static void generateWater(std::mt19937_64& gen) {
+    int wall = tankWallThickness();
+
+    generateTank(gen);
+    fillRect(gen, wall, 0, Grid::width / 3, Grid::height - wall, ParticleTypeID::WATER);
+}
+
+// flat layers of stone, sand and water that are already at rest
+static void generateIdle(std::mt19937_64& gen) {
+    fillRect(gen, 0, Grid::height * 2 / 3, Grid::width, Grid::height, ParticleTypeID::STONE);
+    fillRect(gen, 0, Grid::height / 2, Grid::width, Grid::height * 2 / 3, ParticleTypeID::SAND);
+    fillRect(gen, 0, Grid::height / 3, Grid::width, Grid::height / 2, ParticleTypeID::WATER);
+}
+
+// the same layers with the sand soaked through, so it has no water left to
+// take in and stays at rest with the material reactions on
+static void generateSoaked(std::mt19937_64& gen) {
+    fillRect(gen, 0, Grid::height * 2 / 3, Grid::width, Grid::height, ParticleTypeID::STONE);
+    fillRect(gen, 0, Grid::height / 2, Grid::width, Grid::height * 2 / 3, ParticleTypeID::WET_SAND);
+    fillRect(gen, 0, Grid::height / 3, Grid::width, Grid::height / 2, ParticleTypeID::WATER);
+
+    for(int y = Grid::height / 2; y < Grid::height * 2 / 3; y++) {
+        for(int x = 0; x < Grid::width; x++) {
+            Grid::getData(x, y).wet_sand.moisture = SOAKED_MOISTURE;
+        }
+    }
+}
+
+// stone terrain with pockets of sand and water on top
+static void generateMixed(std::mt19937_64& gen) {
+    std::uniform_int_distribution<int> step(-2, 2);
+    std::uniform_int_distribution<int> chance(0, 9);
+
+    int ground = Grid::height * 3 / 4;
+    for(int x = 0; x < Grid::width; x++) {
+        ground = std::clamp(ground + step(gen), Grid::height / 2, Grid::height - 1);
+        fillRect(gen, x, ground, x + 1, Grid::height, ParticleTypeID::STONE);
+
+        for(int y = Grid::height / 8; y < Grid::height / 3; y++) {
+            int c = chance(gen);
+            if(c < 3) {
+                Grid::setParticle(x, y, ParticleFactory::createParticle(ParticleTypeID::SAND, gen()));
+            }else if(c < 5) {
+                Grid::setParticle(x, y, ParticleFactory::createParticle(ParticleTypeID::WATER, gen()));
+            }
+        }
+    }
+}
+
+std::vector<std::string> Scenes::names() {
+    return {"empty", "sand", "water", "mixed", "tank", "idle", "soaked"};
+}
+
+bool Scenes::generate(const std::string& name, uint32_t seed) {
+    std::mt19937_64 gen(seed);
+
+    if(name == "empty") {
+        return true;
+    }else if(name == "sand") {
+        generateSand(gen);
+    }else if(name == "water") {
+        generateWater(gen);
+    }else if(name == "mixed") {
+        generateMixed(gen);
+    }else if(name == "tank") {
+        generateTank(gen);
+    }else if(name == "idle") {
+        generateIdle(gen);
+    }else if(name == "soaked") {
+        generateSoaked(gen);
+    }else{
+        return false;
+    }
+
+    return true;
+}
+
+bool Scenes::loadText(const std::string& path) {
+    std::ifstream file(path);
+    if(!file) return false;
+
+    std::vector<std::string> lines;
+    std::string line;
+    size_t w = 0;
+    while(std::getline(file, line)) {
+        if(!line.empty() && line.back() == '\r') line.pop_back();
+        w = std::max(w, line.size());
+        lines.push_back(line);
+    }
+
+    if(w == 0 || lines.empty()) return false;
+
+    Grid::init(static_cast<int>(w), static_cast<int>(lines.size()));
+
+    // only picks the shades
+    std::mt19937_64 gen(1);
+
+    for(int y = 0; y < static_cast<int>(lines.size()); y++) {
+        for(int x = 0; x < static_cast<int>(lines[y].size()); x++) {
+            ParticleTypeID type;
+            switch(lines[y][x]) {
+                case 's': type = ParticleTypeID::SAND; break;
+                case 'S': type = ParticleTypeID::WET_SAND; break;
+                case 'w': type = ParticleTypeID::WATER; break;
+                case '#': type = ParticleTypeID::STONE; break;
+                default: continue;
+            }
+            Grid::setParticle(x, y, ParticleFactory::createParticle(type, gen()));
+        }
+    }
+
+    return true;
+}
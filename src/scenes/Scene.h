@@ -0,0 +1,23 @@
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#ifndef SCENE_H
+#define SCENE_H
+
+// Helpers for filling the Grid without any user input, used by the headless tools.
+namespace Scenes {
+    // Names accepted by generate()
+    std::vector<std::string> names();
+
+    // Fill the already initialized Grid with a built in scene.
+    // returns false if the name is unknown
+    bool generate(const std::string& name, uint32_t seed = 1);
+
+    // Initialize the Grid from a text file, one character per cell:
+    // '.' or ' ' empty, 's' sand, 'w' water, '#' stone, 'S' wet sand
+    // returns false if the file can't be read
+    bool loadText(const std::string& path);
+}
+
+#endif // SCENE_H
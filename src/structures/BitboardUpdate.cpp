@@ -0,0 +1,182 @@
+#include "structures/Grid.h"
+#include "structures/ParticleChunk.h"
+#include "particles/ParticleBehavior.h"
+#include "particles/ParticleType.h"
+#include <algorithm>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Bitboard update. Granular materials (see GRANULAR_MIN_SLOPE) move a chunk
+// row at a time, which of the row's 32 grains fall or slide is worked out
+// from bit masks of the grains and ParticleChunk::solid_rows. A row's grains
+// move together, and one that can slide both ways picks a side at random.
+
+bool Grid::bitboard_update = false;
+
+// granular materials moved in bulk, and how many rows beside a grain have to
+// be open for it to slide one column, 0 if it never does
+static uint32_t bulk_types = 0;
+static std::array<int, NUM_PARTICLE_TYPES> slide_drop{};
+
+void Grid::setBitboardUpdate(bool enabled) {
+    bitboard_update = enabled;
+
+    // grains are dropped into any cell that isn't solid, so a material that
+    // floats on some liquid is left to its behaviors
+    bulk_types = 0;
+    for(int type = 0; type < NUM_PARTICLE_TYPES; type++) {
+        ParticleTypeID id = static_cast<ParticleTypeID>(type);
+        if(GRANULAR_MIN_SLOPE[type] == 0) continue;
+
+        bool sinks = true;
+        for(int other = 0; other < NUM_PARTICLE_TYPES; other++) {
+            ParticleTypeID liquid = static_cast<ParticleTypeID>(other);
+            if(ParticleTypeRegistry::getState(liquid) == MatterState::LIQUID &&
+                ParticleTypeRegistry::getDensity(liquid) >= ParticleTypeRegistry::getDensity(id)) {
+                sinks = false;
+            }
+        }
+        if(!sinks) continue;
+
+        // spread looks 3 rows down, a slope of 0.6 needs one open row beside the grain, 2.0 two
+        bulk_types |= 1u << type;
+        int drop = (GRANULAR_MIN_SLOPE[type] + 99) / 100;
+        slide_drop[type] = drop <= 3 ? drop : 0;
+    }
+}
+
+bool Grid::isBitboardUpdate() {
+    return bitboard_update;
+}
+
+// Bit i is set when the i-th of a chunk row's 32 bytes equals value
+static inline uint32_t findEqualBytes(const uint8_t* bytes, uint8_t value) {
+#if defined(__AVX2__)
+    __m256i row = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(row, _mm256_set1_epi8(static_cast<char>(value)))));
+#elif defined(__SSE2__)
+    __m128i match = _mm_set1_epi8(static_cast<char>(value));
+    __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+    __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + 16));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(low, match))) |
+        (static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(high, match))) << 16);
+#else
+    uint32_t mask = 0;
+    for(int i = 0; i < ParticleChunk::CHUNK_SIZE; i++) {
+        if(bytes[i] == value) mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+// Solid cells of row y from the column left of a chunk to the column right of
+// it, bit 0 is the left one. Cells outside the grid count as solid
+uint64_t Grid::getSolidSpan(int chunk_x, int y) {
+    if(y < 0 || y >= height) return ~0ull;
+
+    int row_start = (y >> ParticleChunk::CHUNK_SHIFT) * num_particle_chunks_x;
+    int local_y = y & ParticleChunk::CHUNK_MASK;
+    auto loadRow = [&](int x) -> uint64_t {
+        return particleChunks[row_start + x]->solid_rows[local_y].load(std::memory_order_relaxed);
+    };
+
+    uint64_t span = loadRow(chunk_x) << 1;
+    span |= chunk_x > 0 ? loadRow(chunk_x - 1) >> ParticleChunk::CHUNK_MASK : 1;
+    span |= (chunk_x + 1 < num_particle_chunks_x ? loadRow(chunk_x + 1) & 1 : 1) << (ParticleChunk::CHUNK_SIZE + 1);
+
+    // the last chunk can hang over the right edge
+    int inside = width - chunk_x * ParticleChunk::CHUNK_SIZE;
+    if(inside <= ParticleChunk::CHUNK_SIZE) span |= ~0ull << (inside + 1);
+    return span;
+}
+
+// Move the queued granular cells of one chunk row. Returns the cells
+// that are done for this tick: the grains that moved, and the ones with solid
+// cells below and on both sides that their behaviors couldn't move either
+uint32_t Grid::settleGranularRow(ParticleChunk& chunk, int y) {
+    uint32_t types = chunk.type_bitmask & bulk_types;
+    if(types == 0) return 0;
+
+    int left = chunk.x * ParticleChunk::CHUNK_SIZE;
+    int row_start = (y & ParticleChunk::CHUNK_MASK) * ParticleChunk::CHUNK_SIZE;
+    const uint8_t* row_types = chunk.type_ids.data() + row_start;
+
+    // queued cells that haven't moved yet this tick
+    uint32_t active = chunk.queued_rows[y & ParticleChunk::CHUNK_MASK];
+    active &= ~findEqualBytes(chunk.changed_stamps.data() + row_start, current_stamp);
+
+    // the masks below are spans like getSolidSpan(), bit 0 is the column left of the chunk
+    std::array<uint64_t, NUM_PARTICLE_TYPES> grains{};
+    uint64_t all_grains = 0;
+    int depth = 1;
+    for(int type = 0; type < NUM_PARTICLE_TYPES; type++) {
+        if(!(types & (1u << type))) continue;
+        grains[type] = static_cast<uint64_t>(findEqualBytes(row_types, static_cast<uint8_t>(type)) & active) << 1;
+        all_grains |= grains[type];
+        depth = std::max(depth, slide_drop[type]);
+    }
+    if(all_grains == 0) return 0;
+
+    std::array<uint64_t, 4> solid;
+    for(int r = 0; r <= depth; r++) {
+        solid[r] = getSolidSpan(chunk.x, y + r);
+    }
+
+    // straight down into anything that isn't solid
+    uint64_t falls = all_grains & ~solid[1];
+    solid[0] &= ~falls;
+    solid[1] |= falls;
+
+    // then down a slope, one material at a time. A grain with room on both
+    // sides picks one at random, two grains sliding into the same cell both stay
+    uint64_t coin = random(left, y, Random::STREAM_SLIDE).next() << 1;
+    uint64_t slide_left = 0, slide_right = 0;
+    for(int type = 0; type < NUM_PARTICLE_TYPES; type++) {
+        uint64_t resting = grains[type] & ~falls;
+        if(resting == 0 || slide_drop[type] == 0) continue;
+
+        uint64_t blocked = solid[0];
+        for(int r = 1; r <= slide_drop[type]; r++) {
+            blocked |= solid[r];
+        }
+        uint64_t can_left = resting & (~blocked << 1);
+        uint64_t can_right = resting & (~blocked >> 1);
+        uint64_t both = can_left & can_right;
+
+        uint64_t to_left = (can_left & ~both) | (both & coin);
+        uint64_t to_right = (can_right & ~both) | (both & ~coin);
+        uint64_t clash = to_left & (to_right << 2);
+        to_left &= ~clash;
+        to_right &= ~(clash >> 2);
+
+        solid[0] &= ~(to_left | to_right);
+        solid[1] |= (to_left >> 1) | (to_right << 1);
+        slide_left |= to_left;
+        slide_right |= to_right;
+    }
+
+    uint64_t moved = falls | slide_left | slide_right;
+    uint64_t boxed_in = all_grains & ~moved & solid[1] & (solid[0] << 1) & (solid[0] >> 1);
+
+    if(moved == 0) return static_cast<uint32_t>(boxed_in >> 1);
+
+    // now swap the cells of the grains that moved, and wake around all of them at once
+    for(uint64_t bits = falls; bits != 0; bits &= bits - 1) {
+        int x = left + __builtin_ctzll(bits) - 1;
+        swapCells(x, y, x, y + 1);
+    }
+    for(uint64_t bits = slide_left; bits != 0; bits &= bits - 1) {
+        int x = left + __builtin_ctzll(bits) - 1;
+        swapCells(x, y, x - 1, y + 1);
+    }
+    for(uint64_t bits = slide_right; bits != 0; bits &= bits - 1) {
+        int x = left + __builtin_ctzll(bits) - 1;
+        swapCells(x, y, x + 1, y + 1);
+    }
+    int first = left + __builtin_ctzll(moved) - 1;
+    int last = left + 63 - __builtin_clzll(moved) - 1;
+    onAreaUpdate(std::max(first - 1, 0), y, std::min(last + 1, width - 1), y + 1);
+
+    return static_cast<uint32_t>((moved | boxed_in) >> 1);
+}
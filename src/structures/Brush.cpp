@@ -0,0 +1,11 @@
+#include "structures/Brush.h"
+#include "structures/Grid.h"
+
+
+void Brush::apply(const BrushCommand& command) {
+    if(command.action == BrushAction::PLACE) {
+        Grid::fillCircle(command.x, command.y, command.radius, command.type);
+    }else if(command.action == BrushAction::REMOVE) {
+        Grid::fillCircle(command.x, command.y, command.radius, ParticleTypeID::EMPTY);
+    }
+}
@@ -0,0 +1,26 @@
+#include <cstdint>
+#include "particles/ParticleType.h"
+
+#ifndef BRUSH_H
+#define BRUSH_H
+
+enum class BrushAction : uint8_t {
+    NONE,
+    PLACE,
+    REMOVE,
+};
+
+// Brush state sent from the event loop, applied before every tick until the next one arrives
+struct BrushCommand {
+    BrushAction action = BrushAction::NONE;
+    int x = 0, y = 0;       // center cell
+    int radius = 0;         // in cells
+    ParticleTypeID type = ParticleTypeID::SAND;
+};
+
+namespace Brush {
+    // Paint one brush stroke into the Grid, cells outside the grid are skipped
+    void apply(const BrushCommand& command);
+}
+
+#endif // BRUSH_H
@@ -1,7 +1,9 @@
 #include "structures/Grid.h"
 #include "particles/Particle.h"
 #include "particles/ParticleFactory.h"
+#include "particles/ParticleBehavior.h"
 #include "structures/ParticleChunk.h"
+#include "util/Profiler.h"
 #include <vector>
 #include <shared_mutex>
 #include <thread>
@@ -9,86 +11,286 @@
 #include <queue>
 #include <atomic>
 #include <stdexcept>
-
-
-Particle* Grid::particles = nullptr;
-std::vector<Particle*> Grid::processing_queue;
-ThreadGroup<ProcessingChunk> Grid::processing_threads;
-ProcessingChunk* Grid::processing_chunks = nullptr;
+#include <algorithm>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+uint8_t Grid::current_stamp = 1;
+ParticleChunk Grid::empty_chunk;
+std::vector<int> Grid::allocated_chunks;
+std::vector<int> Grid::free_candidates;
+std::vector<int> Grid::active_chunks;
+std::vector<int> Grid::next_active_chunks;
+TaskScheduler Grid::processing_threads;
+std::vector<int> Grid::phase_chunks[4];
+std::vector<WorkerContext> Grid::workers(1);
+TickStats Grid::last_tick_stats;
+uint64_t Grid::serial_swaps = 0;
+bool Grid::checkerboard_update = false;
+
+// set while a worker thread is processing a chunk, nullptr on the main thread
+static thread_local WorkerContext* worker_context = nullptr;
+static thread_local ParticleChunk* worker_chunk = nullptr;
 
 int Grid::width = 0;
 int Grid::height = 0;
-int Grid::num_particles = 0;
-int Grid::num_threads = 0;
+int Grid::num_threads = 1;
+uint64_t Grid::seed = 1;
+uint64_t Grid::tick = 0;
 int Grid::num_particle_chunks_x = 0;
 int Grid::num_particle_chunks_y = 0;
 
-std::vector<ParticleChunk> Grid::particleChunks;
+std::vector<ParticleChunk*> Grid::particleChunks;
+
+// Bit i is set when the i-th of a chunk row's 32 type bytes is a material with
+// behaviors. Static materials are compared 16 or 32 bytes at a time.
+static inline uint32_t findBehaviorCells(const uint8_t* types) {
+#if defined(__AVX2__)
+    __m256i row = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(types));
+    __m256i is_static = _mm256_setzero_si256();
+    for(int type = 0; type < NUM_PARTICLE_TYPES; type++) {
+        if(STATIC_MATERIALS[type]) {
+            is_static = _mm256_or_si256(is_static, _mm256_cmpeq_epi8(row, _mm256_set1_epi8(static_cast<char>(type))));
+        }
+    }
+    return ~static_cast<uint32_t>(_mm256_movemask_epi8(is_static));
+#elif defined(__SSE2__)
+    __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(types));
+    __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(types + 16));
+    __m128i low_static = _mm_setzero_si128();
+    __m128i high_static = _mm_setzero_si128();
+    for(int type = 0; type < NUM_PARTICLE_TYPES; type++) {
+        if(STATIC_MATERIALS[type]) {
+            __m128i value = _mm_set1_epi8(static_cast<char>(type));
+            low_static = _mm_or_si128(low_static, _mm_cmpeq_epi8(low, value));
+            high_static = _mm_or_si128(high_static, _mm_cmpeq_epi8(high, value));
+        }
+    }
+    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(low_static)) |
+        (static_cast<uint32_t>(_mm_movemask_epi8(high_static)) << 16);
+    return ~mask;
+#else
+    uint32_t mask = 0;
+    for(int i = 0; i < ParticleChunk::CHUNK_SIZE; i++) {
+        if(!isStaticMaterial(static_cast<ParticleTypeID>(types[i]))) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
 
-void Grid::processingTask(ProcessingChunk chunk, int thread_id) {
-    for(int y = chunk.y + chunk.height - 1; y >= chunk.y; y--) {
-        for(int dx = 0; dx < chunk.width; dx++) {
-            int x;
-            if(chunk.is_flipped != (y % 2 == 0)) {
-                x = chunk.x + (chunk.width - 1 - dx);
-            }else{
-                x = chunk.x + dx;
-            }
+// Run the queued cells of one chunk row, jumping straight between the ones that
+// have behaviors. The queue is read again on every step because a wake can
+// still add cells further along the row. Cells that turn into a material with
+// behaviors during the row are always marked changed, so the mask taken up
+// front doesn't miss any.
+void Grid::processRow(int index, int y, bool reverse) {
+    ParticleChunk& chunk = *particleChunks[index];
+    int left = chunk.x * ParticleChunk::CHUNK_SIZE;
+    int row_start = (y & ParticleChunk::CHUNK_MASK) * ParticleChunk::CHUNK_SIZE;
+    const uint8_t* row_types = chunk.type_ids.data() + row_start;
+    const uint32_t& queued = chunk.queued_rows[y & ParticleChunk::CHUNK_MASK];
+
+    uint32_t cells = findBehaviorCells(row_types);
+    if(bitboard_update) {
+        cells &= ~settleGranularRow(chunk, y);
+    }
 
-            int i = y * width + x;
-            if(i < 0 || i >= num_particles) continue;  // Out of bounds check
-            particles[i].onBlockUpdate();
+    // cells keeps the ones still ahead of the sweep
+    if(reverse) {
+        while(uint32_t next = cells & queued) {
+            int bit = 31 - __builtin_clz(next);
+            cells &= (1u << bit) - 1;
+            updateCell(chunk, row_start + bit, left + bit, y);
+        }
+    }else{
+        while(uint32_t next = cells & queued) {
+            int bit = __builtin_ctz(next);
+            cells &= ~1u << bit;
+            updateCell(chunk, row_start + bit, left + bit, y);
         }
     }
 }
 
+// Run one chunk's rect bottom up, alternating the row direction like the serial sweep
+void Grid::processChunk(int index, bool is_flipped) {
+    ParticleChunk& chunk = *particleChunks[index];
+    worker_chunk = &chunk;
+
+    int top = chunk.y * ParticleChunk::CHUNK_SIZE;
+    int bottom = std::min(top + ParticleChunk::CHUNK_SIZE, height) - 1;
+
+    for(int y = bottom; y >= top; y--) {
+        if(chunk.queued_rows[y & ParticleChunk::CHUNK_MASK] == 0) continue;
+        processRow(index, y, is_flipped != (y%2==0));
+    }
+
+    worker_chunk = nullptr;
+}
+
+void Grid::setThreadCount(int count) {
+    count = std::max(count, 1);
+    if(count == num_threads) return;
+
+    num_threads = count;
+    processing_threads.terminate();
+    workers.clear();
+    workers.resize(num_threads);
+
+    if(num_threads > 1) {
+        processing_threads.initializeThreads(num_threads);
+    }
+}
+
+void Grid::setCheckerboardUpdate(bool enabled) {
+    checkerboard_update = enabled;
+}
+
+bool Grid::isCheckerboardUpdate() {
+    return checkerboard_update;
+}
+
+void Grid::setSeed(uint64_t new_seed) {
+    seed = new_seed;
+}
+
+uint64_t Grid::computeChecksum() {
+    // FNV-1a over the size, then each chunk holding something by index and
+    // cells. Unallocated chunks and allocated ones that emptied out only add
+    // their count, so a world's checksum doesn't depend on what is allocated
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto add = [&hash](uint64_t value, int bytes) {
+        for(int b = 0; b < bytes; b++) {
+            hash ^= (value >> (b * 8)) & 0xff;
+            hash *= 0x100000001b3ULL;
+        }
+    };
+
+    add(static_cast<uint32_t>(width), 4);
+    add(static_cast<uint32_t>(height), 4);
+
+    static std::vector<int> occupied_chunks;
+    occupied_chunks.clear();
+    for(int index : allocated_chunks) {
+        if(!particleChunks[index]->isEmpty()) occupied_chunks.push_back(index);
+    }
+    std::sort(occupied_chunks.begin(), occupied_chunks.end());
+
+    for(int index : occupied_chunks) {
+        const ParticleChunk& chunk = *particleChunks[index];
+        add(static_cast<uint32_t>(index), 4);
+        for(int i = 0; i < ParticleChunk::CHUNK_AREA; i++) {
+            add(chunk.type_ids[i], 1);
+            add(chunk.shades[i], 1);
+            add(chunk.payloads[i].raw, 4);
+        }
+    }
+
+    add(particleChunks.size() - occupied_chunks.size(), 8);
+    return hash;
+}
+
 void Grid::init(int w, int h) {
+    if(!particleChunks.empty()) {
+        cleanup();
+    }
+
     width = w;
     height = h;
-    num_particles = width * height;
+    tick = 0;
+    current_stamp = 1;
 
-    particles = new Particle[num_particles];
+    num_particle_chunks_x = (width + ParticleChunk::CHUNK_SIZE - 1) / ParticleChunk::CHUNK_SIZE;
+    num_particle_chunks_y = (height + ParticleChunk::CHUNK_SIZE - 1) / ParticleChunk::CHUNK_SIZE;
 
-    for(int i = 0; i < num_particles; i++) {
-        particles[i] = ParticleFactory::createParticle(ParticleTypeID::EMPTY);
-    }
+    active_chunks.clear();
+    next_active_chunks.clear();
 
-    num_particle_chunks_x = 0;
-    num_particle_chunks_y = 0;
+    // nothing is allocated until a particle is placed
+    empty_chunk.type_bitmask = 1 << static_cast<int>(ParticleTypeID::EMPTY);
+    particleChunks.assign(static_cast<size_t>(num_particle_chunks_x) * num_particle_chunks_y, &empty_chunk);
+}
 
-    particleChunks.clear();
+ParticleChunk& Grid::allocateChunk(int index) {
+    ParticleChunk* chunk = new ParticleChunk();
+    chunk->x = index % num_particle_chunks_x;
+    chunk->y = index / num_particle_chunks_x;
+    chunk->last_used_tick = tick;
+    chunk->rebuildTypeData();
+
+    chunk->allocated_slot = static_cast<int>(allocated_chunks.size());
+    allocated_chunks.push_back(index);
+    particleChunks[index] = chunk;
+
+    // stays allocated until it has held something, or CHUNK_FREE_DELAY ticks pass
+    chunk->free_candidate = true;
+    free_candidates.push_back(index);
+    return *chunk;
+}
+
+void Grid::freeChunk(int index) {
+    ParticleChunk* chunk = particleChunks[index];
 
-    for(int y = 0; y <= 1 + height/ParticleChunk::CHUNK_SIZE; y++){
-        num_particle_chunks_y ++;
-        num_particle_chunks_x = 0;
-        for(int x = 0; x <= 1 + width/ParticleChunk::CHUNK_SIZE; x++){
-            num_particle_chunks_x ++;
-            ParticleChunk chunk;
-            chunk.x = x;
-            chunk.y = y;
-            particleChunks.push_back(chunk);
+    // move the last allocated chunk into the freed slot
+    int last = allocated_chunks.back();
+    allocated_chunks[chunk->allocated_slot] = last;
+    particleChunks[last]->allocated_slot = chunk->allocated_slot;
+    allocated_chunks.pop_back();
+
+    particleChunks[index] = &empty_chunk;
+    delete chunk;
+}
+
+// Give back chunks that are empty, asleep and haven't been used for a while
+void Grid::freeEmptyChunks() {
+    size_t kept = 0;
+    for(int index : free_candidates) {
+        if(!isChunkAllocated(index)) continue;
+
+        ParticleChunk& chunk = *particleChunks[index];
+        if(!chunk.isEmpty()) {
+            chunk.free_candidate = false;
+        }else if(chunk.shouldProcess || chunk.shouldProcessNextFrame || tick - chunk.last_used_tick < CHUNK_FREE_DELAY) {
+            free_candidates[kept++] = index;
+        }else{
+            freeChunk(index);
         }
     }
+    free_candidates.resize(kept);
+}
 
-    num_threads = 4;
-
-    processing_chunks = new ProcessingChunk[num_threads*2];
-    {
-        int dy = (height) / (num_threads*2) + 1;
-        for(int i = 0; i < num_threads*2; i++) {
-            processing_chunks[i].x = 0;
-            processing_chunks[i].y = dy*i;
-            processing_chunks[i].width = width;
-            processing_chunks[i].height = dy;
+// Workers can't allocate, so before a checkerboard sweep every chunk an active
+// chunk could write into (3 cells reach a direct neighbor at most) is allocated
+void Grid::allocateNeighbors(int index) {
+    int chunk_x = index % num_particle_chunks_x;
+    int chunk_y = index / num_particle_chunks_x;
+
+    for(int y = std::max(chunk_y - 1, 0); y <= std::min(chunk_y + 1, num_particle_chunks_y - 1); y++) {
+        for(int x = std::max(chunk_x - 1, 0); x <= std::min(chunk_x + 1, num_particle_chunks_x - 1); x++) {
+            int neighbor = y * num_particle_chunks_x + x;
+            if(isChunkAllocated(neighbor)) {
+                particleChunks[neighbor]->last_used_tick = tick;
+            }else{
+                allocateChunk(neighbor);
+            }
         }
     }
-    
-    processing_threads.initializeThreads(num_threads);
-    processing_threads.setFunction(&processingTask);
 }
 
-Particle& Grid::getParticle(int x, int y){
-    return particles[y * width + x];
+int Grid::getAllocatedChunkCount() {
+    return static_cast<int>(allocated_chunks.size());
+}
+
+Particle Grid::getParticle(int x, int y){
+    const ParticleChunk& chunk = getParticleChunk(x, y);
+    int i = ParticleChunk::getLocalIndex(x, y);
+
+    Particle particle(static_cast<ParticleTypeID>(chunk.type_ids[i]), chunk.shades[i]);
+    particle.data = chunk.payloads[i];
+    return particle;
 }
 
 bool Grid::isInBounds(int x, int y) {
@@ -96,17 +298,69 @@ bool Grid::isInBounds(int x, int y) {
 }
 
 
+static inline bool isSolidType(ParticleTypeID type) {
+    return ParticleTypeRegistry::getState(type) == MatterState::SOLID;
+}
+
+// Flip the solid bit of a cell that changed between solid and not. Only one
+// worker writes its own chunk, but workers on both sides can write the same
+// row of a neighbor chunk, those writes need the locked instruction
+static inline void toggleSolid(ParticleChunk& chunk, int local) {
+    std::atomic<uint32_t>& row = chunk.solid_rows[local >> ParticleChunk::CHUNK_SHIFT];
+    uint32_t bit = 1u << (local & ParticleChunk::CHUNK_MASK);
+    if(worker_context != nullptr && &chunk != worker_chunk) {
+        row.fetch_xor(bit, std::memory_order_relaxed);
+    }else{
+        row.store(row.load(std::memory_order_relaxed) ^ bit, std::memory_order_relaxed);
+    }
+}
+
+// Move one cell of chunk_index's count from one type to another
+void Grid::applyTypeChange(int chunk_index, ParticleTypeID from, ParticleTypeID to) {
+    ParticleChunk& chunk = *particleChunks[chunk_index];
+    chunk.removeType(from);
+    chunk.addType(to);
+
+    if(chunk.isEmpty() && !chunk.free_candidate) {
+        chunk.free_candidate = true;
+        free_candidates.push_back(chunk_index);
+    }
+}
+
+// Keep the chunk counts in step with a cell of chunk_index changing type. Workers
+// can write into the same neighbor chunk, so theirs wait for the end of the phase
+void Grid::countTypeChange(int chunk_index, ParticleTypeID from, ParticleTypeID to) {
+    if(from == to) return;
+
+    if(worker_context != nullptr) {
+        worker_context->type_changes.push_back({chunk_index, from, to});
+        return;
+    }
+    applyTypeChange(chunk_index, from, to);
+}
+
 void Grid::setParticle(int x, int y, Particle particle) {
     if(!isInBounds(x, y)) {
         printf("Attempted to set out of bounds particle at (%d, %d)\n", x, y);
         return;  // Out of bounds
     }
 
-    particle.x = x;  // Set particle's position
-    particle.y = y;
-    particle.hasChanged = true;  // Mark as changed
+    int index = getParticleChunkIndex(x, y);
+    if(!isChunkAllocated(index)) {
+        if(particle.type_id == ParticleTypeID::EMPTY) return;  // already empty
+        allocateChunk(index);
+    }
 
-    particles[y * width + x] = particle;
+    ParticleChunk& chunk = *particleChunks[index];
+    int i = ParticleChunk::getLocalIndex(x, y);
+    ParticleTypeID old_type = static_cast<ParticleTypeID>(chunk.type_ids[i]);
+    countTypeChange(index, old_type, particle.type_id);
+    if(isSolidType(old_type) != isSolidType(particle.type_id)) toggleSolid(chunk, i);
+    chunk.type_ids[i] = particle.type_id;
+    chunk.shades[i] = particle.shade;
+    chunk.payloads[i] = particle.data;
+    chunk.changed_stamps[i] = current_stamp;  // Mark as changed
+    chunk.updated_stamps[i] = 0;
 
     onParticleUpdate(x, y);
 }
@@ -117,68 +371,181 @@ void Grid::removeParticle(int x, int y) {
         return;  // Out of bounds
     }
 
-    Particle& existing = particles[y * width + x];
+    int index = getParticleChunkIndex(x, y);
+    if(!isChunkAllocated(index)) return;  // already empty
+
+    ParticleChunk& chunk = *particleChunks[index];
+    int i = ParticleChunk::getLocalIndex(x, y);
     Particle empty = ParticleFactory::createParticle(ParticleTypeID::EMPTY);
-    existing = empty;  // Copy the empty particle's data
+    ParticleTypeID old_type = static_cast<ParticleTypeID>(chunk.type_ids[i]);
+    countTypeChange(index, old_type, empty.type_id);
+    if(isSolidType(old_type)) toggleSolid(chunk, i);
+    chunk.type_ids[i] = empty.type_id;
+    chunk.shades[i] = empty.shade;
+    chunk.payloads[i] = empty.data;
+    chunk.changed_stamps[i] = 0;
+    chunk.updated_stamps[i] = 0;
 
     onParticleUpdate(x, y);
 }
 
 void Grid::swapParticles(int x0, int y0, int x1, int y1) {
 
-    // Pre-calculate indices once
-    int idx0 = y0 * width + x0;
-    int idx1 = y1 * width + x1;
-    
-    // Bounds check on indices (faster than coordinate checks)
-    if (idx0 < 0 || idx0 >= num_particles || idx1 < 0 || idx1 >= num_particles) {
+    if (!isInBounds(x0, y0) || !isInBounds(x1, y1)) {
         printf("Attempted to swap out of bounds particles at (%d, %d) and (%d, %d)\n", x0, y0, x1, y1);
         return;
     }
-    
-    // Use std::swap (compiler optimized)
-    std::swap(particles[idx0], particles[idx1]);
-    
-    // Update positions efficiently
-    particles[idx0].x = x0;
-    particles[idx0].y = y0;
-    particles[idx0].hasChanged = true;
-    
-    particles[idx1].x = x1;
-    particles[idx1].y = y1;
-    particles[idx1].hasChanged = true;
-    
-    // Batch render updates
-    onParticleUpdate(x0, y0);
-    onParticleUpdate(x1, y1);
+
+    swapCells(x0, y0, x1, y1);
+
+    // Batch render updates, cells whose wakes overlap share one
+    if(std::abs(x1 - x0) <= WAKE_RADIUS_X && std::abs(y1 - y0) <= 1) {
+        onAreaUpdate(std::min(x0, x1), std::min(y0, y1), std::max(x0, x1), std::max(y0, y1));
+    }else{
+        onParticleUpdate(x0, y0);
+        onParticleUpdate(x1, y1);
+    }
 }
 
-void updateChunk(int x, int y){
-    ParticleChunk& chunk = Grid::getParticleChunk(x, y);
-    chunk.dirty = true;
-    chunk.type_data_valid = false;  // Invalidate type data
-    chunk.shouldProcessNextFrame = true;  // Mark for processing next frame
+// Swap two cells inside the grid without waking anything, the caller does that
+void Grid::swapCells(int x0, int y0, int x1, int y1) {
+    // Pre-calculate indices once. On worker threads both chunks are already
+    // allocated, see allocateNeighbors()
+    int index0 = getParticleChunkIndex(x0, y0);
+    int index1 = getParticleChunkIndex(x1, y1);
+    ParticleChunk& chunk0 = isChunkAllocated(index0) ? *particleChunks[index0] : allocateChunk(index0);
+    ParticleChunk& chunk1 = isChunkAllocated(index1) ? *particleChunks[index1] : allocateChunk(index1);
+    int i0 = ParticleChunk::getLocalIndex(x0, y0);
+    int i1 = ParticleChunk::getLocalIndex(x1, y1);
+
+    // a swap inside one chunk leaves its counts as they are
+    ParticleTypeID type0 = static_cast<ParticleTypeID>(chunk0.type_ids[i0]);
+    ParticleTypeID type1 = static_cast<ParticleTypeID>(chunk1.type_ids[i1]);
+    if(index0 != index1) {
+        countTypeChange(index0, type0, type1);
+        countTypeChange(index1, type1, type0);
+    }
+    if(isSolidType(type0) != isSolidType(type1)) {
+        toggleSolid(chunk0, i0);
+        toggleSolid(chunk1, i1);
+    }
+
+    // Only the cell contents move, positions come from the index
+    std::swap(chunk0.type_ids[i0], chunk1.type_ids[i1]);
+    std::swap(chunk0.shades[i0], chunk1.shades[i1]);
+    std::swap(chunk0.payloads[i0], chunk1.payloads[i1]);
+    std::swap(chunk0.updated_stamps[i0], chunk1.updated_stamps[i1]);
+
+    chunk0.changed_stamps[i0] = current_stamp;
+    chunk1.changed_stamps[i1] = current_stamp;
+
+    if(worker_context != nullptr) {
+        worker_context->swaps++;
+    }else{
+        serial_swaps++;
+    }
 }
 
 void Grid::onParticleUpdate(int x, int y) {
-    // if(x % ParticleChunk::CHUNK_SIZE == 0){
-    //     updateChunk(x-1, y);
-    // }else if(x % ParticleChunk::CHUNK_SIZE == ParticleChunk::CHUNK_SIZE - 1){
-    //     updateChunk(x+1, y);
-    // }
+    onAreaUpdate(x, y, x, y);
+}
+
+void Grid::onAreaUpdate(int x0, int y0, int x1, int y1) {
+    if(worker_context != nullptr) {
+        ParticleChunk& chunk = *worker_chunk;
+        int left = chunk.x * ParticleChunk::CHUNK_SIZE;
+        int top = chunk.y * ParticleChunk::CHUNK_SIZE;
+        int wake_x0 = std::max(x0 - WAKE_RADIUS_X, 0);
+        int wake_y0 = std::max(y0 - WAKE_RADIUS_UP, 0);
+        int wake_x1 = std::min(x1 + WAKE_RADIUS_X, width - 1);
+        int wake_y1 = std::min(y1 + WAKE_RADIUS_DOWN, height - 1);
+
+        // this worker owns its chunk, so a wake that stays inside it is done
+        // in place while the chunk runs next tick anyway
+        bool inside = wake_x0 >= left && wake_y0 >= top &&
+            wake_x1 < left + ParticleChunk::CHUNK_SIZE && wake_y1 < top + ParticleChunk::CHUNK_SIZE;
+        if(inside && chunk.shouldProcessNextFrame) {
+            chunk.dirty = true;
+            wakeArea(wake_x0, wake_y0, wake_x1, wake_y1);
+            return;
+        }
+
+        // other workers may be touching the same neighbor chunks, so the
+        // bookkeeping waits for the end of the phase
+        worker_context->updates.push_back({x0, y0, x1, y1});
+
+        // but grow this chunk's rect now so a collapse still finishes within the tick
+        wake_x0 = std::max(wake_x0, left);
+        wake_y0 = std::max(wake_y0, top);
+        wake_x1 = std::min(wake_x1, left + ParticleChunk::CHUNK_SIZE - 1);
+        wake_y1 = std::min(wake_y1, top + ParticleChunk::CHUNK_SIZE - 1);
+        if(wake_x0 <= wake_x1 && wake_y0 <= wake_y1) {
+            ParticleChunk::queueCells(chunk.queued_rows, chunk.rect, wake_x0, wake_y0, wake_x1, wake_y1);
+        }
+        return;
+    }
+
+    // redraw the chunks the cells are in
+    for(int chunk_y = y0 >> ParticleChunk::CHUNK_SHIFT; chunk_y <= y1 >> ParticleChunk::CHUNK_SHIFT; chunk_y++) {
+        for(int chunk_x = x0 >> ParticleChunk::CHUNK_SHIFT; chunk_x <= x1 >> ParticleChunk::CHUNK_SHIFT; chunk_x++) {
+            particleChunks[chunk_y * num_particle_chunks_x + chunk_x]->dirty = true;
+        }
+    }
+
+    // wake every particle whose behaviors could read these cells, even across chunk edges
+    wakeArea(x0 - WAKE_RADIUS_X, y0 - WAKE_RADIUS_UP, x1 + WAKE_RADIUS_X, y1 + WAKE_RADIUS_DOWN);
+}
+
+void Grid::wakeArea(int x0, int y0, int x1, int y1) {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, width - 1);
+    y1 = std::min(y1, height - 1);
+    if(x0 > x1 || y0 > y1) return;
+
+    for(int chunk_y = y0 / ParticleChunk::CHUNK_SIZE; chunk_y <= y1 / ParticleChunk::CHUNK_SIZE; chunk_y++) {
+        for(int chunk_x = x0 / ParticleChunk::CHUNK_SIZE; chunk_x <= x1 / ParticleChunk::CHUNK_SIZE; chunk_x++) {
+            int index = chunk_y * num_particle_chunks_x + chunk_x;
+            if(!isChunkAllocated(index)) continue;  // nothing in there to wake
+            ParticleChunk& chunk = *particleChunks[index];
+
+            int left = chunk_x * ParticleChunk::CHUNK_SIZE;
+            int top = chunk_y * ParticleChunk::CHUNK_SIZE;
+            int cx0 = std::max(x0, left);
+            int cy0 = std::max(y0, top);
+            int cx1 = std::min(x1, left + ParticleChunk::CHUNK_SIZE - 1);
+            int cy1 = std::min(y1, top + ParticleChunk::CHUNK_SIZE - 1);
+
+            uint32_t bits = (~0u << (cx0 - left)) & (~0u >> (ParticleChunk::CHUNK_MASK - (cx1 - left)));
+
+            // rows above the sweep are still to come this tick, so let a
+            // collapsing pile keep falling instead of waiting a tick per wake
+            uint32_t now_bits = chunk.shouldProcess ? bits : 0;
+            for(int row = cy0 - top; row <= cy1 - top; row++) {
+                chunk.next_queued_rows[row] |= bits;
+                chunk.queued_rows[row] |= now_bits;
+            }
+            chunk.next_rect.include(cx0, cy0, cx1, cy1);
+            if(chunk.shouldProcess) {
+                chunk.rect.include(cx0, cy0, cx1, cy1);
+            }
 
-    // if(y % ParticleChunk::CHUNK_SIZE == 0){
-    //     updateChunk(x, y-1);
-    // }else if(y % ParticleChunk::CHUNK_SIZE == ParticleChunk::CHUNK_SIZE - 1){
-    //     updateChunk(x, y+1);
-    // }
+            if(!chunk.shouldProcessNextFrame) {
+                chunk.shouldProcessNextFrame = true;
+                next_active_chunks.push_back(index);
+            }
+        }
+    }
+}
 
-    updateChunk(x,y);
+int Grid::getActiveChunkCount() {
+    return static_cast<int>(active_chunks.size());
 }
 
 // Check if there could be a particle of the specified type in the neighborhood
 // return false guarantees no particles of that type are present
 // return true means there could be particles of that type in the neighborhood
+// (the chunk counts are exact, but on a worker thread they lag behind until the phase ends)
 bool Grid::isParticleNearType(int x, int y, ParticleTypeID type, int max_x, int max_y) {
     // Calculate the bounding box of the search area
     int min_x = x - max_x;
@@ -201,7 +568,7 @@ bool Grid::isParticleNearType(int x, int y, ParticleTypeID type, int max_x, int
     // Check each unique chunk only once
     for(int chunk_y = min_chunk_y; chunk_y <= max_chunk_y; chunk_y++) {
         for(int chunk_x = min_chunk_x; chunk_x <= max_chunk_x; chunk_x++) {
-            ParticleChunk& chunk = particleChunks[chunk_y * num_particle_chunks_x + chunk_x];
+            const ParticleChunk& chunk = *particleChunks[chunk_y * num_particle_chunks_x + chunk_x];
             if(chunk.hasParticleType(type)) {
                 return true;
             }
@@ -211,91 +578,226 @@ bool Grid::isParticleNearType(int x, int y, ParticleTypeID type, int max_x, int
     return false;
 }
 
-void Grid::processParticles() {
-    static bool is_flipped = false;
-    is_flipped = !is_flipped;
-
-    for(int x = 0; x < num_particle_chunks_x; x++){
-        for(int y = 0; y < num_particle_chunks_y; y++) {
-            ParticleChunk& chunk = particleChunks[y * num_particle_chunks_x + x];
-            if(!chunk.type_data_valid) {
-                chunk.rebuildTypeData();
-            }
+void Grid::updateCell(ParticleChunk& chunk, int local, int x, int y) {
+    if(chunk.changed_stamps[local] == current_stamp) return;
+
+    chunk.updated_stamps[local] = current_stamp;
+
+    ParticleTypeID type = static_cast<ParticleTypeID>(chunk.type_ids[local]);
+    if(isStaticMaterial(type)) return;
+
+    Behaviors::update(type, x, y);
+}
+
+void Grid::updateParticle(int x, int y) {
+    int index = getParticleChunkIndex(x, y);
+    if(!isChunkAllocated(index)) return;  // only empty cells in there
+
+    updateCell(*particleChunks[index], ParticleChunk::getLocalIndex(x, y), x, y);
+}
+
+// Start a new tick's stamp. Stamps are 8 bit, so once every 255 ticks they
+// wrap and the arrays are cleared to stop old stamps from matching again.
+void Grid::advanceStamp() {
+    current_stamp++;
+    if(current_stamp == 0) {
+        for(int index : allocated_chunks) {
+            ParticleChunk& chunk = *particleChunks[index];
+            chunk.changed_stamps.fill(0);
+            chunk.updated_stamps.fill(0);
         }
+        current_stamp = 1;
     }
+}
 
-    // for(int x = 0; x < num_particle_chunks_x; x++){
-    //     for(int y = num_particle_chunks_y - 1; y >= 0; y--) {
-    //         ParticleChunk& chunk = particleChunks[y * num_particle_chunks_x + x];
-    //         if(chunk.shouldProcess) {
-    //             for(int i = ParticleChunk::CHUNK_SIZE-1; i >=0; i--){
-    //                 for(int j = 0; j < ParticleChunk::CHUNK_SIZE; j++) {
-    //                     int x = j + chunk.x * ParticleChunk::CHUNK_SIZE;
-    //                     int y = i + chunk.y * ParticleChunk::CHUNK_SIZE;
-    //                     int index = y*width + x;
-    //                     if(index < num_particles)
-    //                         particles[y*width + x].onBlockUpdate();
-    //                 }
-    //             }
-    //         }
-    //     }
-    // }
-
-    for(int y = height - 1; y >= 0; y--){
-        for(int x0 = 0; x0 < width; x0++) {
-            int x = x0;
-            if(is_flipped != (y%2==0)){
-                x = width - x0 - 1;
-            }
-            
-            particles[y * width + x].onBlockUpdate();
+// One tick is a single sweep over the active rects. The per cell flags expire
+// by themselves through the tick stamp, and the chunks' type counts are kept up
+// to date as cells are written, so there is no reset or rebuild pass.
+void Grid::processParticles() {
+    // alternate the row direction every tick
+    bool is_flipped = (tick % 2) == 0;
+
+    uint64_t start = Profiler::now();
+    advanceStamp();
+    uint64_t stamped = Profiler::now();
+
+    // put last tick's chunks to sleep, the ones that were woken take their place
+    for(int index : active_chunks) {
+        ParticleChunk& chunk = *particleChunks[index];
+        chunk.shouldProcess = false;
+        chunk.rect.clear();
+        chunk.queued_rows.fill(0);
+    }
+
+    active_chunks.swap(next_active_chunks);
+    next_active_chunks.clear();
+
+    for(int index : active_chunks) {
+        ParticleChunk& chunk = *particleChunks[index];
+        chunk.shouldProcess = true;
+        chunk.shouldProcessNextFrame = false;
+        chunk.rect = chunk.next_rect;
+        chunk.next_rect.clear();
+        chunk.queued_rows = chunk.next_queued_rows;
+        chunk.next_queued_rows.fill(0);
+        chunk.last_used_tick = tick;
+    }
+
+    // no chunk is referenced by the lists now except the active ones
+    freeEmptyChunks();
+
+    // bottom chunk row first, left to right within a row
+    std::sort(active_chunks.begin(), active_chunks.end(), [](int a, int b) {
+        int row_a = a / num_particle_chunks_x;
+        int row_b = b / num_particle_chunks_x;
+        return row_a != row_b ? row_a > row_b : a < b;
+    });
+
+    serial_swaps = 0;
+    for(WorkerContext& worker : workers) {
+        worker.swaps = 0;
+    }
+
+    if(checkerboard_update) {
+        for(int index : active_chunks) {
+            allocateNeighbors(index);
         }
     }
 
-    for(int x = 0; x < num_particle_chunks_x; x++){
-        for(int y = 0; y < num_particle_chunks_y; y++) {
-            ParticleChunk& chunk = particleChunks[y * num_particle_chunks_x + x];
-            // chunk.shouldProcess = chunk.shouldProcessNextFrame;
-            // chunk.shouldProcessNextFrame = false;
-            chunk.dirty = true;
+    uint64_t activated = Profiler::now();
+    if(checkerboard_update) {
+        processParallel(is_flipped);
+    }else{
+        processSerial(is_flipped);
+    }
+    uint64_t swept = Profiler::now();
+
+    last_tick_stats.reacted = 0;
+    if(material_reactions) {
+        runReactions();
+    }
+    uint64_t reacted = Profiler::now();
+
+    last_tick_stats.levelled = 0;
+    if(liquid_levelling) {
+        levelLiquids();
+    }
+    uint64_t levelled = Profiler::now();
+
+    last_tick_stats.stamp_ns = stamped - start;
+    last_tick_stats.activate_ns = activated - stamped;
+    last_tick_stats.sweep_ns = swept - activated;
+    last_tick_stats.react_ns = reacted - swept;
+    last_tick_stats.level_ns = levelled - reacted;
+    last_tick_stats.allocated_chunks = static_cast<int>(allocated_chunks.size());
+    last_tick_stats.active_chunks = static_cast<int>(active_chunks.size());
+    last_tick_stats.swaps = serial_swaps;
+    for(const WorkerContext& worker : workers) {
+        last_tick_stats.swaps += worker.swaps;
+    }
+
+    tick++;
+}
+
+const TickStats& Grid::getLastTickStats() {
+    return last_tick_stats;
+}
+
+std::array<uint64_t, NUM_PARTICLE_TYPES> Grid::getMaterialCensus() {
+    std::array<uint64_t, NUM_PARTICLE_TYPES> census{};
+    for(int index : allocated_chunks) {
+        const ParticleChunk& chunk = *particleChunks[index];
+        for(int type = 0; type < NUM_PARTICLE_TYPES; type++) {
+            census[type] += chunk.type_counts[type];
         }
     }
 
-    // for(int y = height - 1; y >= 0; y--) {
-    //     for(int x0 = 0; x0 < width; x0++) {
-    //         int x = x0;
-    //         if(is_flipped != (y%2==0)){
-    //             x = width - x0 - 1;
-    //         }
-            
-    //         particles[y * width + x].onBlockUpdate();
-    //     }
-    // }
+    // unallocated chunks only hold empty cells
+    uint64_t occupied = 0;
+    for(int type = 0; type < NUM_PARTICLE_TYPES; type++) {
+        if(type != ParticleTypeID::EMPTY) occupied += census[type];
+    }
+    census[ParticleTypeID::EMPTY] = static_cast<uint64_t>(width) * height - occupied;
+    return census;
+}
+
+// Sweep rows bottom up in the same serpentine order as a full grid pass,
+// but only over the active chunks' rects
+void Grid::processSerial(bool is_flipped) {
+    size_t row_begin = 0;
+    while(row_begin < active_chunks.size()) {
+        int chunk_y = active_chunks[row_begin] / num_particle_chunks_x;
+        size_t row_end = row_begin;
+        while(row_end < active_chunks.size() && active_chunks[row_end] / num_particle_chunks_x == chunk_y) {
+            row_end++;
+        }
 
-    // for(int offset0 = 0; offset0 <= 1; offset0++) {
-    //     int offset = offset0;
-    //     if(is_flipped){
-    //         offset = 1 - offset0;  // Flip offset for even/odd rows
-    //     }
+        int top = chunk_y * ParticleChunk::CHUNK_SIZE;
+        int bottom = std::min(top + ParticleChunk::CHUNK_SIZE, height) - 1;
 
-    //     for(int i = 0; i < num_threads; i++) {
-    //         ProcessingChunk& chunk = processing_chunks[i*2 + offset];
-    //         chunk.is_flipped = is_flipped;
-    //         processing_threads.setThreadData(i, chunk);
-    //     }
+        for(int y = bottom; y >= top; y--) {
+            bool flip_row = is_flipped != (y%2==0);
+            for(size_t n = 0; n < row_end - row_begin; n++) {
+                int index = active_chunks[flip_row ? row_end - 1 - n : row_begin + n];
+                if(particleChunks[index]->queued_rows[y & ParticleChunk::CHUNK_MASK] == 0) continue;
+                processRow(index, y, flip_row);
+            }
+        }
 
-    //     processing_threads.executeAndWait();
-    // }
+        row_begin = row_end;
+    }
 }
 
+// Checkerboard update: chunks of one color are 32 cells apart, further than any
+// behavior reads (8) plus writes (3), so a phase's chunks can run on any thread
+// in any order without touching each other's cells.
+void Grid::processParallel(bool is_flipped) {
+    for(std::vector<int>& chunks : phase_chunks) {
+        chunks.clear();
+    }
+    for(int index : active_chunks) {
+        const ParticleChunk& chunk = *particleChunks[index];
+        phase_chunks[(chunk.x & 1) | ((chunk.y & 1) << 1)].push_back(index);
+    }
 
-void Grid::cleanup() {
-    delete[] particles;
-    particles = nullptr;
+    for(int phase = 0; phase < 4; phase++) {
+        const std::vector<int>& chunks = phase_chunks[phase];
+        if(chunks.empty()) continue;
+
+        // one chunk per task, idle workers steal from the busy ones
+        processing_threads.parallelFor(static_cast<int>(chunks.size()), 1, [&](int begin, int end, int worker_id) {
+            worker_context = &workers[worker_id];
+            for(int i = begin; i < end; i++) {
+                processChunk(chunks[i], is_flipped);
+            }
+            worker_context = nullptr;
+        });
+
+        // apply the workers' chunk bookkeeping in thread order, none of it
+        // depends on the order
+        for(WorkerContext& worker : workers) {
+            for(const DeferredUpdate& update : worker.updates) {
+                onAreaUpdate(update.x0, update.y0, update.x1, update.y1);
+            }
+            worker.updates.clear();
 
-    for(auto& chunk : Grid::particleChunks) {
-        if(chunk.texture != nullptr) {
-            SDL_DestroyTexture(chunk.texture);
+            for(const TypeChange& change : worker.type_changes) {
+                applyTypeChange(change.chunk, change.from, change.to);
+            }
+            worker.type_changes.clear();
         }
     }
+}
+
+
+void Grid::cleanup() {
+    for(int index : allocated_chunks) {
+        delete particleChunks[index];
+    }
+    allocated_chunks.clear();
+    free_candidates.clear();
+    active_chunks.clear();
+    next_active_chunks.clear();
+
+    particleChunks.clear();
 }
\ No newline at end of file
@@ -1,78 +1,317 @@
 #include "particles/Particle.h"
+#include "util/Random.h"
 #include <vector>
-#include <SDL3/SDL.h>
+#include <string>
+#include <array>
 #include <shared_mutex>
 #include <queue>
 #include <atomic>
 #include <thread>
 #include <condition_variable>
-#include "ThreadGroup.h"
+#include "structures/TaskScheduler.h"
 
 #ifndef GRID_H
 #define GRID_H
 
 #include "structures/ParticleChunk.h"
 
-struct ProcessingChunk{
-    int x, y;
-    int width, height;
-    int is_flipped;
+// Cells changed on a worker thread, an inclusive rectangle applied once the phase is done
+struct DeferredUpdate{
+    int x0, y0, x1, y1;
 };
 
+// A cell in chunk `chunk` turned from one type into another on a worker thread
+struct TypeChange{
+    int chunk;
+    ParticleTypeID from, to;
+};
+
+// Per worker state for the checkerboard update. Changes a worker can't make
+// in place go to its own lists, read back once the phase is done
+struct WorkerContext{
+    std::vector<DeferredUpdate> updates;
+    std::vector<TypeChange> type_changes;
+    uint64_t swaps = 0;
+};
+
+// Counters and phase times for the last processParticles() call
+struct TickStats{
+    uint64_t swaps = 0;         // cells moved
+    int active_chunks = 0;      // chunks simulated
+    int allocated_chunks = 0;   // chunks allocated at the end of the tick
+
+    // wall time in ns
+    uint64_t stamp_ns = 0;      // starting the tick's stamp
+    uint64_t activate_ns = 0;   // waking this tick's chunks, allocating and freeing chunks
+    uint64_t sweep_ns = 0;      // behaviors, including merging worker results
+    uint64_t level_ns = 0;      // liquid levelling pass, 0 on ticks without one
+    uint64_t levelled = 0;      // cells moved by it
+    uint64_t react_ns = 0;      // material reactions pass
+    uint64_t reacted = 0;       // reactions that fired in it
+};
+
+// The world is a table of 32x32 ParticleChunks, each storing its cells
+// structure-of-arrays. Chunks are allocated when something is placed in them
+// and given back once they have been empty for a while; until then their
+// table entry points at a shared chunk that is always empty, so reads never
+// have to check. Memory follows the occupied area, not the world size.
 class Grid {
     private:
-        static Particle* particles;
-        static std::vector<Particle*> processing_queue;
-        static ThreadGroup<ProcessingChunk> processing_threads;
-        static ProcessingChunk* processing_chunks;
+        // Tick stamps instead of per cell flags: a cell changed (or had its
+        // behaviors run) this tick when its stamp equals current_stamp, so
+        // nothing has to be cleared between ticks
+        static uint8_t current_stamp;
+
+        // what unallocated table entries point at, never written
+        static ParticleChunk empty_chunk;
+        // indices of the allocated chunks, in no particular order
+        static std::vector<int> allocated_chunks;
+        // allocated chunks that were empty when last looked at
+        static std::vector<int> free_candidates;
+
+        // chunks with a non empty rect this tick, and the ones woken for the next tick
+        static std::vector<int> active_chunks;
+        static std::vector<int> next_active_chunks;
+        static TaskScheduler processing_threads;
+
+        // active chunks split by checkerboard color, (x & 1) | (y & 1) << 1
+        static std::vector<int> phase_chunks[4];
+        // one list per worker thread
+        static std::vector<WorkerContext> workers;
+        static TickStats last_tick_stats;
+        static uint64_t serial_swaps;
+        static bool checkerboard_update;
+        static bool liquid_levelling;
+        static bool bitboard_update;
+        static bool material_reactions;
+        static uint32_t level_pass;     // counts levelLiquids() calls, for ParticleChunk::level_visited
 
     public:
-        static int width, height, num_particles, num_threads;
+        // How far a change can affect other particles' behaviors. spread looks
+        // up to 8 cells sideways and 4 rows down, the rest only touch neighbors.
+        static const int WAKE_RADIUS_X = 8;
+        static const int WAKE_RADIUS_UP = 4;
+        static const int WAKE_RADIUS_DOWN = 1;
+
+        // position of the asked for cell in a getSolidRow() window
+        static const int SOLID_ROW_CENTER = 16;
+
+        // ticks an empty, sleeping chunk is kept before it is freed
+        static const int CHUNK_FREE_DELAY = 64;
+
+        // most cells one liquid levelling pass flood fills per body
+        static const int LEVEL_MAX_BODY = 1 << 20;
+
+        static int width, height, num_threads;
+        static uint64_t seed;       // behaviors' random numbers only depend on this
+        static uint64_t tick;       // number of processParticles() calls since init
         static int num_particle_chunks_x, num_particle_chunks_y;
         
 
-        static std::vector<ParticleChunk> particleChunks;
+        // one entry per chunk, row major. Unallocated chunks point at the shared empty chunk
+        static std::vector<ParticleChunk*> particleChunks;
 
         static void init(int w, int h);
         static void cleanup();
 
+        // Binary snapshots of the whole world, see GridSnapshot.cpp for the format.
+        // Loading replaces the grid, seed and tick, and decodes chunks on the worker threads.
+        // both return false if the file can't be written or read
+        static bool saveSnapshot(const std::string& path);
+        static bool loadSnapshot(const std::string& path);
+        // the same on an in memory copy, source only names it in error messages
+        static bool encodeSnapshot(std::vector<uint8_t>& out);
+        static bool decodeSnapshot(const uint8_t* bytes, size_t size, const std::string& source);
+        // true if the file starts like a snapshot, whether or not the rest is intact
+        static bool isSnapshotFile(const std::string& path);
+
+        // Workers used by the checkerboard update
+        static void setThreadCount(int count);
+
+        // The checkerboard update gives the same result for any thread count,
+        // the serial sweep processes whole grid rows instead of chunk by chunk
+        static void setCheckerboardUpdate(bool enabled);
+        static bool isCheckerboardUpdate();
+
+        // Level bodies of liquid in bulk after every sweep, on by default.
+        // See LiquidLevelling.cpp
+        static void setLiquidLevelling(bool enabled);
+        static bool isLiquidLevelling();
+
+        // Move granular materials a chunk row at a time with bit masks instead
+        // of running their behaviors cell by cell, off by default. It has its own
+        // results, see BitboardUpdate.cpp. Set after ParticleTypeRegistry::initialize()
+        static void setBitboardUpdate(bool enabled);
+        static bool isBitboardUpdate();
+
+        // Run the material reactions (sand soaking up water) after every sweep,
+        // on by default. See Reactions.cpp and the table in Reaction.h
+        static void setMaterialReactions(bool enabled);
+        static bool isMaterialReactions();
+
+        static void setSeed(uint64_t new_seed);
+
+        // Random bits for a behavior at (x, y) this tick
+        static inline Random::CellRandom random(int x, int y, uint32_t stream) {
+            return Random::CellRandom(seed, tick, x, y, stream);
+        };
+
+        static const TickStats& getLastTickStats();
+
+        // Number of cells of each type in the whole grid, summed from the chunk counts
+        static std::array<uint64_t, NUM_PARTICLE_TYPES> getMaterialCensus();
+        static int getAllocatedChunkCount();
+
+        // Hash of every cell's contents, equal grids give equal checksums
+        static uint64_t computeChecksum();
+
+        static inline int getParticleChunkIndex(int px, int py) {
+            return (py >> ParticleChunk::CHUNK_SHIFT) * num_particle_chunks_x + (px >> ParticleChunk::CHUNK_SHIFT);
+        };
+        // may be the shared empty chunk, see isChunkAllocated()
+        static inline ParticleChunk& getParticleChunk(int px, int py) {
+            return *particleChunks[getParticleChunkIndex(px, py)];
+        };
+        static inline bool isChunkAllocated(int index) {
+            return particleChunks[index] != &empty_chunk;
+        };
+
+        // Copy out the whole cell, prefer the field accessors below in hot code
+        static Particle getParticle(int x, int y);
+
+        static inline ParticleTypeID getType(int x, int y) {
+            return static_cast<ParticleTypeID>(getParticleChunk(x, y).type_ids[ParticleChunk::getLocalIndex(x, y)]);
+        };
+        static inline MatterState getState(int x, int y) {
+            return ParticleTypeRegistry::getState(getType(x, y));
+        };
+        static inline uint8_t getShade(int x, int y) {
+            return getParticleChunk(x, y).shades[ParticleChunk::getLocalIndex(x, y)];
+        };
+        // only for cells holding a particle, the empty chunk must not be written
+        static inline ParticleTypeData& getData(int x, int y) {
+            return getParticleChunk(x, y).payloads[ParticleChunk::getLocalIndex(x, y)];
+        };
+        static inline Color getColor(int x, int y) {
+            return getParticle(x, y).getColor();
+        };
+
+        // One chunk's CHUNK_AREA cells in local index order, for copying whole chunks out
+        static inline const uint8_t* getChunkTypes(int index) {
+            return particleChunks[index]->type_ids.data();
+        };
+        static inline const uint8_t* getChunkShades(int index) {
+            return particleChunks[index]->shades.data();
+        };
+        static inline const ParticleTypeData* getChunkPayloads(int index) {
+            return particleChunks[index]->payloads.data();
+        };
+
+        // Moved or was replaced this tick
+        static inline bool hasChanged(int x, int y) {
+            return getParticleChunk(x, y).changed_stamps[ParticleChunk::getLocalIndex(x, y)] == current_stamp;
+        };
+        // Had its behaviors run this tick
+        static inline bool receivedUpdate(int x, int y) {
+            return getParticleChunk(x, y).updated_stamps[ParticleChunk::getLocalIndex(x, y)] == current_stamp;
+        };
+        // only for cells holding a particle
+        static inline void markChanged(int x, int y) {
+            getParticleChunk(x, y).changed_stamps[ParticleChunk::getLocalIndex(x, y)] = current_stamp;
+        };
 
-        static Particle& getParticle(int x, int y);
         static inline bool isCellEmpty(int x, int y) {
             if(x < 0 || x >= width || y < 0 || y >= height) {
                 return false;  // Out of bounds
             }
-            return getParticle(x, y).type_id == ParticleTypeID::EMPTY;
+            return getType(x, y) == ParticleTypeID::EMPTY;
         };
         static inline bool isCellNonSolid(int x, int y) {
             if(x < 0 || x >= width || y < 0 || y >= height) {
                 return false;  // Out of bounds
             }
 
-            return particles[y * width + x].state != MatterState::SOLID;
-        };
-        static bool isInBounds(int x, int y);
-        static inline int getParticleIndex(int x, int y) {
-            return y * width + x;  // Calculate index based on grid dimensions
+            return ParticleTypeRegistry::getState(getType(x, y)) != MatterState::SOLID;
         };
-        static inline int getParticleChunkIndex(int px, int py) {
-            int chunk_x = px / ParticleChunk::CHUNK_SIZE;
-            int chunk_y = py / ParticleChunk::CHUNK_SIZE;
-            return chunk_y * num_particle_chunks_x + chunk_x;
-        };
-        static inline ParticleChunk& getParticleChunk(int px, int py) {
-            return particleChunks[getParticleChunkIndex(px, py)];
+        // Solid cells of row y from x - SOLID_ROW_CENTER on, one bit per cell
+        // with (x, y) at bit SOLID_ROW_CENTER. Cells outside the grid count as solid
+        static inline uint32_t getSolidRow(int x, int y) {
+            if(y < 0 || y >= height) return ~0u;
+
+            // the window spans two chunks, chunks left of the grid are all solid
+            int left = x - SOLID_ROW_CENTER;
+            int chunk_x = left >> ParticleChunk::CHUNK_SHIFT;
+            int row_start = (y >> ParticleChunk::CHUNK_SHIFT) * num_particle_chunks_x;
+            int local_y = y & ParticleChunk::CHUNK_MASK;
+            uint64_t low = chunk_x >= 0 ?
+                particleChunks[row_start + chunk_x]->solid_rows[local_y].load(std::memory_order_relaxed) : ~0u;
+            uint64_t high = chunk_x + 1 < num_particle_chunks_x ?
+                particleChunks[row_start + chunk_x + 1]->solid_rows[local_y].load(std::memory_order_relaxed) : ~0u;
+            uint32_t row = static_cast<uint32_t>((low | high << ParticleChunk::CHUNK_SIZE) >> (left & ParticleChunk::CHUNK_MASK));
+
+            // the last chunk can hang over the right edge
+            int inside = width - left;
+            if(inside < ParticleChunk::CHUNK_SIZE) row |= ~0u << inside;
+            return row;
         };
+        static bool isInBounds(int x, int y);
         static bool isParticleNearType(int x, int y, ParticleTypeID type, int max_x=1, int max_y=1);
 
+        // Region edits for brushes and tools, on the thread that owns the Grid.
+        // Every cell of the shape that doesn't hold type already gets a new
+        // particle of it (EMPTY clears it), and each chunk touched is woken once.
+        // Cells outside the grid are skipped. They return the cells changed,
+        // see GridEdit.cpp
+        static int fillCircle(int center_x, int center_y, int radius, ParticleTypeID type);
+        static int fillRect(int x0, int y0, int x1, int y1, ParticleTypeID type);
+        // the circle of radius stamped at every cell of the line
+        static int fillLine(int x0, int y0, int x1, int y1, int radius, ParticleTypeID type);
+        // mask is mask_width * mask_height bytes row by row with (x, y) at its
+        // top left, the cells where it isn't 0 are filled
+        static int stampMask(int x, int y, int mask_width, int mask_height, const uint8_t* mask, ParticleTypeID type);
+
         static void setParticle(int x, int y, Particle particle);
         static void removeParticle(int x, int y);
         static void swapParticles(int x0, int y0, int x1, int y1);
         static void onParticleUpdate(int x, int y);
+        // The same for every cell of an inclusive rectangle inside the grid
+        static void onAreaUpdate(int x0, int y0, int x1, int y1);
+
+        // Queue the cells in the inclusive rectangle for processing next tick, and
+        // for the rest of this one if their chunk is active. Cells that nothing
+        // woke sleep, so a tick only runs the cells near something that changed
+        static void wakeArea(int x0, int y0, int x1, int y1);
+        static int getActiveChunkCount();
+
+        // Run the behaviors of the particle at (x, y) unless it already changed this tick
+        static void updateParticle(int x, int y);
 
         static void processParticles();
-        static void processingTask(ProcessingChunk chunk, int thread_id);
+
+    private:
+        static ParticleChunk& allocateChunk(int index);
+        static void freeChunk(int index);
+        static void freeEmptyChunks();
+        static void allocateNeighbors(int index);
+        static void updateCell(ParticleChunk& chunk, int local, int x, int y);
+        static void applyTypeChange(int chunk_index, ParticleTypeID from, ParticleTypeID to);
+        static void countTypeChange(int chunk_index, ParticleTypeID from, ParticleTypeID to);
+        static void advanceStamp();
+        static void processRow(int index, int y, bool reverse);
+        static void processChunk(int index, bool is_flipped);
+        static void processSerial(bool is_flipped);
+        static void processParallel(bool is_flipped);
+        static void levelLiquids();
+        static int levelBody(int x, int y, ParticleTypeID type);
+        static void runReactions();
+        static bool reactCell(int x, int y, ParticleTypeID type);
+        static void swapCells(int x0, int y0, int x1, int y1);
+        static uint64_t getSolidSpan(int chunk_x, int y);
+        static uint32_t settleGranularRow(ParticleChunk& chunk, int y);
+        template<typename RowCells>
+        static int fillCells(int x0, int y0, int x1, int y1, ParticleTypeID type, RowCells row_cells);
+        static int fillSpans(int y0, ParticleTypeID type);
 
 };
 
-#endif // GRID_H
\ No newline at end of file
+#endif // GRID_H
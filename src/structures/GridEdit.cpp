@@ -0,0 +1,254 @@
+#include "structures/Grid.h"
+#include "structures/ParticleChunk.h"
+#include "particles/ParticleFactory.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+// Region edits. A shape is written one chunk at a time: the cells of each
+// chunk row it covers are a bit mask, cells that already hold the material are
+// dropped from it, and the rest are written straight into the chunk's arrays.
+// The solid rows are updated once per row and the chunk is woken once, around
+// everything that changed in it, instead of once per cell. Holding a brush
+// still over cells it already filled changes nothing and wakes nothing.
+//
+// New particles get their shade from the seed, the tick and the cell, so edits
+// replay exactly.
+
+// Inclusive columns of one row of a shape, empty when x0 > x1
+struct RowSpan {
+    int x0, x1;
+};
+
+// scratch space reused by every edit
+static std::vector<RowSpan> row_spans;
+static std::vector<int> circle_half_widths;
+
+// Bits of a chunk row from column x0 to x1, both relative to the chunk's left edge
+static inline uint32_t spanBits(int x0, int x1) {
+    x0 = std::max(x0, 0);
+    x1 = std::min(x1, ParticleChunk::CHUNK_SIZE - 1);
+    if(x0 > x1) return 0;
+    return (~0u << x0) & (~0u >> (ParticleChunk::CHUNK_MASK - x1));
+}
+
+// Largest h with h * h <= n
+static inline int floorSqrt(int64_t n) {
+    int64_t h = static_cast<int64_t>(std::sqrt(static_cast<double>(n)));
+    while(h * h > n) h--;
+    while((h + 1) * (h + 1) <= n) h++;
+    return static_cast<int>(h);
+}
+
+// Write the cells picked by row_cells(y, chunk_left) inside the inclusive
+// bounds, returns the cells changed
+template<typename RowCells>
+int Grid::fillCells(int x0, int y0, int x1, int y1, ParticleTypeID type, RowCells row_cells) {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, width - 1);
+    y1 = std::min(y1, height - 1);
+    if(x0 > x1 || y0 > y1) return 0;
+
+    bool solid = ParticleTypeRegistry::getState(type) == MatterState::SOLID;
+    int changed = 0;
+
+    for(int chunk_y = y0 >> ParticleChunk::CHUNK_SHIFT; chunk_y <= y1 >> ParticleChunk::CHUNK_SHIFT; chunk_y++) {
+        int top = chunk_y * ParticleChunk::CHUNK_SIZE;
+        int row_begin = std::max(y0, top);
+        int row_end = std::min(y1, top + ParticleChunk::CHUNK_MASK);
+
+        for(int chunk_x = x0 >> ParticleChunk::CHUNK_SHIFT; chunk_x <= x1 >> ParticleChunk::CHUNK_SHIFT; chunk_x++) {
+            int index = chunk_y * num_particle_chunks_x + chunk_x;
+            int left = chunk_x * ParticleChunk::CHUNK_SIZE;
+            uint32_t inside = spanBits(x0 - left, x1 - left);
+
+            // unallocated chunks are empty already
+            if(!isChunkAllocated(index) && type == ParticleTypeID::EMPTY) continue;
+
+            DirtyRect edited;
+            for(int y = row_begin; y <= row_end; y++) {
+                uint32_t cells = row_cells(y, left) & inside;
+                if(cells == 0) continue;
+
+                if(!isChunkAllocated(index)) allocateChunk(index);
+                ParticleChunk& chunk = *particleChunks[index];
+                int row_start = (y & ParticleChunk::CHUNK_MASK) * ParticleChunk::CHUNK_SIZE;
+
+                uint32_t written = 0;
+                for(; cells != 0; cells &= cells - 1) {
+                    int bit = __builtin_ctz(cells);
+                    int i = row_start + bit;
+                    ParticleTypeID old_type = static_cast<ParticleTypeID>(chunk.type_ids[i]);
+                    if(old_type == type) continue;
+
+                    Particle particle = ParticleFactory::createParticle(type, random(left + bit, y, Random::STREAM_BRUSH).next());
+                    applyTypeChange(index, old_type, type);
+                    chunk.type_ids[i] = particle.type_id;
+                    chunk.shades[i] = particle.shade;
+                    chunk.payloads[i] = particle.data;
+                    chunk.changed_stamps[i] = type == ParticleTypeID::EMPTY ? 0 : current_stamp;
+                    chunk.updated_stamps[i] = 0;
+                    written |= 1u << bit;
+                }
+                if(written == 0) continue;
+
+                std::atomic<uint32_t>& solid_row = chunk.solid_rows[y & ParticleChunk::CHUNK_MASK];
+                uint32_t solid_bits = solid_row.load(std::memory_order_relaxed) & ~written;
+                solid_row.store(solid ? solid_bits | written : solid_bits, std::memory_order_relaxed);
+
+                edited.include(left + __builtin_ctz(written), y, left + 31 - __builtin_clz(written), y);
+                changed += __builtin_popcount(written);
+            }
+
+            if(!edited.isEmpty()) {
+                onAreaUpdate(edited.min_x, edited.min_y, edited.max_x, edited.max_y);
+            }
+        }
+    }
+    return changed;
+}
+
+// Fill rows y0 on from row_spans
+int Grid::fillSpans(int y0, ParticleTypeID type) {
+    int min_x = width, max_x = -1;
+    for(const RowSpan& span : row_spans) {
+        if(span.x0 > span.x1) continue;
+        min_x = std::min(min_x, span.x0);
+        max_x = std::max(max_x, span.x1);
+    }
+    int y1 = y0 + static_cast<int>(row_spans.size()) - 1;
+
+    return fillCells(min_x, y0, max_x, y1, type, [y0](int y, int left) {
+        const RowSpan& span = row_spans[y - y0];
+        return spanBits(span.x0 - left, span.x1 - left);
+    });
+}
+
+int Grid::fillCircle(int center_x, int center_y, int radius, ParticleTypeID type) {
+    if(radius <= 0) return 0;
+
+    // the cells closer than radius to the center
+    row_spans.clear();
+    for(int dy = -radius + 1; dy < radius; dy++) {
+        int half = floorSqrt(static_cast<int64_t>(radius) * radius - static_cast<int64_t>(dy) * dy - 1);
+        row_spans.push_back({center_x - half, center_x + half});
+    }
+    return fillSpans(center_y - radius + 1, type);
+}
+
+int Grid::fillRect(int x0, int y0, int x1, int y1, ParticleTypeID type) {
+    if(x0 > x1) std::swap(x0, x1);
+    if(y0 > y1) std::swap(y0, y1);
+
+    return fillCells(x0, y0, x1, y1, type, [x0, x1](int, int left) {
+        return spanBits(x0 - left, x1 - left);
+    });
+}
+
+int Grid::fillLine(int x0, int y0, int x1, int y1, int radius, ParticleTypeID type) {
+    if(radius <= 0) return 0;
+
+    // Bresenham, every point touches the one before it. Point k is k steps
+    // along the longer axis and rounds the other, so the points that can
+    // reach the grid are found without walking the ones that can't
+    int dx = std::abs(x1 - x0), step_x = x0 < x1 ? 1 : -1;
+    int dy = -std::abs(y1 - y0), step_y = y0 < y1 ? 1 : -1;
+    int steps = std::max(dx, -dy);
+    auto pointAt = [&](int k, int& x, int& y) {
+        if(steps == 0) {
+            x = x0;
+            y = y0;
+        }else if(dx >= -dy) {
+            x = x0 + step_x * k;
+            y = y0 + step_y * static_cast<int>((2 * static_cast<int64_t>(-dy) * k + dx) / (2 * static_cast<int64_t>(dx)));
+        }else{
+            y = y0 + step_y * k;
+            x = x0 + step_x * static_cast<int>((2 * static_cast<int64_t>(dx) * k - dy) / (-2 * static_cast<int64_t>(dy)));
+        }
+    };
+
+    // a circle reaches radius - 1 cells from its center, both coordinates
+    // move monotonically along the line so the points in reach are a range
+    int reach = radius - 1;
+    int min_x = -reach, max_x = width - 1 + reach;
+    int min_y = -reach, max_y = height - 1 + reach;
+    auto entered = [&](int k) {
+        int x, y;
+        pointAt(k, x, y);
+        return (step_x > 0 ? x >= min_x : x <= max_x) && (step_y > 0 ? y >= min_y : y <= max_y);
+    };
+    auto left = [&](int k) {
+        int x, y;
+        pointAt(k, x, y);
+        return (step_x > 0 ? x > max_x : x < min_x) || (step_y > 0 ? y > max_y : y < min_y);
+    };
+    // first k in [low, high] where test holds, high + 1 if none, test only turns on
+    auto firstWhere = [](int low, int high, auto test) {
+        while(low <= high) {
+            int middle = low + (high - low) / 2;
+            if(test(middle)) high = middle - 1;
+            else low = middle + 1;
+        }
+        return low;
+    };
+    int first = firstWhere(0, steps, entered);
+    int last = firstWhere(first, steps, left) - 1;
+    if(first > last) return 0;
+
+    int first_x, first_y, last_x, last_y;
+    pointAt(first, first_x, first_y);
+    pointAt(last, last_x, last_y);
+    int top = std::max(std::min(first_y, last_y) - reach, 0);
+    int bottom = std::min(std::max(first_y, last_y) + reach, height - 1);
+    if(top > bottom) return 0;
+
+    // the circle stamped at every point of the line, like dragging the brush
+    row_spans.assign(bottom - top + 1, RowSpan{width, -1});
+    circle_half_widths.resize(radius);
+    for(int offset = 0; offset < radius; offset++) {
+        circle_half_widths[offset] = floorSqrt(static_cast<int64_t>(radius) * radius - static_cast<int64_t>(offset) * offset - 1);
+    }
+
+    // the error term at the first point, as if the walk had started at x0, y0
+    int x = first_x, y = first_y;
+    int error = static_cast<int>(dx + dy + static_cast<int64_t>(std::abs(x - x0)) * dy + static_cast<int64_t>(std::abs(y - y0)) * dx);
+    while(true) {
+        int row_begin = std::max(y - reach, top);
+        int row_end = std::min(y + reach, bottom);
+        for(int row = row_begin; row <= row_end; row++) {
+            RowSpan& span = row_spans[row - top];
+            int h = circle_half_widths[std::abs(row - y)];
+            span.x0 = std::min(span.x0, x - h);
+            span.x1 = std::max(span.x1, x + h);
+        }
+
+        if(x == last_x && y == last_y) break;
+        int doubled = 2 * error;
+        if(doubled >= dy) {
+            error += dy;
+            x += step_x;
+        }
+        if(doubled <= dx) {
+            error += dx;
+            y += step_y;
+        }
+    }
+    return fillSpans(top, type);
+}
+
+int Grid::stampMask(int x, int y, int mask_width, int mask_height, const uint8_t* mask, ParticleTypeID type) {
+    if(mask_width <= 0 || mask_height <= 0) return 0;
+
+    return fillCells(x, y, x + mask_width - 1, y + mask_height - 1, type, [=](int cell_y, int left) {
+        const uint8_t* row = mask + static_cast<size_t>(cell_y - y) * mask_width;
+        int begin = std::max(left, x);
+        int end = std::min(left + ParticleChunk::CHUNK_SIZE, x + mask_width);
+        uint32_t cells = 0;
+        for(int cell_x = begin; cell_x < end; cell_x++) {
+            if(row[cell_x - x] != 0) cells |= 1u << (cell_x - left);
+        }
+        return cells;
+    });
+}
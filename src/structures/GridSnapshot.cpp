@@ -0,0 +1,444 @@
+#include "structures/Grid.h"
+#include "structures/ParticleChunk.h"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Binary world snapshot, all integers little endian.
+//
+//  header   "FSSN", u32 version, u32 width, u32 height, u64 seed, u64 tick,
+//           u32 chunk size, u32 entry count
+//  table    (version 3) one 24 byte entry per allocated chunk, in chunk index
+//           order: u32 chunk index, u64 offset, u32 size, u8 encoding,
+//           u8 awake, u8 rect min_x, min_y, max_x, max_y (chunk local),
+//           u8 padding[2]
+//  wake     (version 2) one u32 per row for each awake chunk, in table order:
+//           the cells queued for the next tick, bit 0 the left column
+//  data     each chunk's encoded cells, in the tiled order of the grid arrays
+//
+// A cell is 6 bytes: u8 type, u8 shade, u32 payload. Chunks that hold nothing
+// but empty cells have no data at all, chunks of a single cell value store it
+// once, the rest are runs of u16 length followed by the cell. The awake flag,
+// rect and rows are the chunk's wake state for the next tick, so a loaded world
+// carries on exactly like the one that was saved. Chunks without an entry are
+// empty and asleep, so an empty world of any size is just the header.
+//
+// Versions 1 and 2 have an entry for every chunk of the world, without the
+// chunk index. Version 1 snapshots have no rows, the whole rect is woken.
+
+static const char SNAPSHOT_MAGIC[4] = {'F', 'S', 'S', 'N'};
+static const uint32_t SNAPSHOT_VERSION = 3;
+static const size_t HEADER_SIZE = 40;
+static const size_t TABLE_ENTRY_SIZE = 24;
+static const size_t DENSE_TABLE_ENTRY_SIZE = 20;   // versions 1 and 2
+static const size_t WAKE_ROWS_SIZE = 4 * ParticleChunk::CHUNK_SIZE;
+static const size_t CELL_SIZE = 6;
+
+enum ChunkEncoding : uint8_t {
+    CHUNK_EMPTY = 0,
+    CHUNK_UNIFORM = 1,
+    CHUNK_RUNS = 2,
+};
+
+static void put8(std::vector<uint8_t>& out, uint8_t value) {
+    out.push_back(value);
+}
+
+static void put16(std::vector<uint8_t>& out, uint16_t value) {
+    for(int b = 0; b < 2; b++) out.push_back(static_cast<uint8_t>(value >> (b * 8)));
+}
+
+static void put32(std::vector<uint8_t>& out, uint32_t value) {
+    for(int b = 0; b < 4; b++) out.push_back(static_cast<uint8_t>(value >> (b * 8)));
+}
+
+static void put64(std::vector<uint8_t>& out, uint64_t value) {
+    for(int b = 0; b < 8; b++) out.push_back(static_cast<uint8_t>(value >> (b * 8)));
+}
+
+static uint16_t get16(const uint8_t* in) {
+    return static_cast<uint16_t>(in[0] | (in[1] << 8));
+}
+
+static uint32_t get32(const uint8_t* in) {
+    return static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) |
+        (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+static uint64_t get64(const uint8_t* in) {
+    return static_cast<uint64_t>(get32(in)) | (static_cast<uint64_t>(get32(in + 4)) << 32);
+}
+
+// Read only view of a whole file, mapped where the platform allows it
+class MappedFile {
+    public:
+        ~MappedFile() {
+#ifdef __unix__
+            if(mapping != nullptr) munmap(mapping, length);
+#endif
+        }
+
+        bool open(const std::string& path) {
+#ifdef __unix__
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if(fd < 0) return false;
+
+            struct stat info;
+            if(fstat(fd, &info) != 0 || info.st_size <= 0) {
+                close(fd);
+                return false;
+            }
+
+            length = static_cast<size_t>(info.st_size);
+            void* result = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if(result == MAP_FAILED) return false;
+
+            mapping = result;
+            bytes = static_cast<const uint8_t*>(mapping);
+            return true;
+#else
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            if(!file) return false;
+
+            length = static_cast<size_t>(file.tellg());
+            buffer.resize(length);
+            file.seekg(0);
+            if(length == 0 || !file.read(reinterpret_cast<char*>(buffer.data()), length)) return false;
+
+            bytes = buffer.data();
+            return true;
+#endif
+        }
+
+        const uint8_t* data() const { return bytes; }
+        size_t size() const { return length; }
+
+    private:
+        const uint8_t* bytes = nullptr;
+        size_t length = 0;
+#ifdef __unix__
+        void* mapping = nullptr;
+#else
+        std::vector<uint8_t> buffer;
+#endif
+};
+
+bool Grid::encodeSnapshot(std::vector<uint8_t>& out) {
+    if(particleChunks.empty()) return false;
+
+    // unallocated chunks are empty and asleep, only the rest get an entry
+    static std::vector<int> stored_chunks;
+    stored_chunks.assign(allocated_chunks.begin(), allocated_chunks.end());
+    std::sort(stored_chunks.begin(), stored_chunks.end());
+
+    std::vector<uint8_t> header;
+    std::vector<uint8_t> table;
+    std::vector<uint8_t> wake;
+    std::vector<uint8_t> data;
+
+    header.insert(header.end(), SNAPSHOT_MAGIC, SNAPSHOT_MAGIC + 4);
+    put32(header, SNAPSHOT_VERSION);
+    put32(header, static_cast<uint32_t>(width));
+    put32(header, static_cast<uint32_t>(height));
+    put64(header, seed);
+    put64(header, tick);
+    put32(header, ParticleChunk::CHUNK_SIZE);
+    put32(header, static_cast<uint32_t>(stored_chunks.size()));
+
+    // only chunks woken for the next tick have a wake state worth keeping
+    auto isAwake = [](const ParticleChunk& chunk) {
+        return chunk.shouldProcessNextFrame && !chunk.next_rect.isEmpty();
+    };
+    size_t num_awake = 0;
+    for(int index : stored_chunks) {
+        if(isAwake(*particleChunks[index])) num_awake++;
+    }
+
+    size_t data_start = HEADER_SIZE + TABLE_ENTRY_SIZE * stored_chunks.size() + WAKE_ROWS_SIZE * num_awake;
+
+    for(int index : stored_chunks) {
+        const ParticleChunk& chunk = *particleChunks[index];
+
+        auto sameCell = [&chunk](int a, int b) {
+            return chunk.type_ids[a] == chunk.type_ids[b] && chunk.shades[a] == chunk.shades[b] && chunk.payloads[a].raw == chunk.payloads[b].raw;
+        };
+        auto putCell = [&data, &chunk](int i) {
+            put8(data, chunk.type_ids[i]);
+            put8(data, chunk.shades[i]);
+            put32(data, chunk.payloads[i].raw);
+        };
+
+        bool uniform = true;
+        for(int i = 1; i < ParticleChunk::CHUNK_AREA && uniform; i++) {
+            uniform = sameCell(0, i);
+        }
+
+        size_t offset = data.size();
+        uint8_t encoding;
+        if(uniform && chunk.type_ids[0] == ParticleTypeID::EMPTY && chunk.shades[0] == 0 && chunk.payloads[0].raw == 0) {
+            encoding = CHUNK_EMPTY;
+        }else if(uniform) {
+            encoding = CHUNK_UNIFORM;
+            putCell(0);
+        }else{
+            encoding = CHUNK_RUNS;
+            int run_start = 0;
+            for(int i = 1; i <= ParticleChunk::CHUNK_AREA; i++) {
+                if(i == ParticleChunk::CHUNK_AREA || !sameCell(run_start, i)) {
+                    put16(data, static_cast<uint16_t>(i - run_start));
+                    putCell(run_start);
+                    run_start = i;
+                }
+            }
+        }
+
+        bool awake = isAwake(chunk);
+        int left = (index % num_particle_chunks_x) * ParticleChunk::CHUNK_SIZE;
+        int top = (index / num_particle_chunks_x) * ParticleChunk::CHUNK_SIZE;
+
+        put32(table, static_cast<uint32_t>(index));
+        put64(table, encoding == CHUNK_EMPTY ? 0 : data_start + offset);
+        put32(table, static_cast<uint32_t>(data.size() - offset));
+        put8(table, encoding);
+        put8(table, awake ? 1 : 0);
+        put8(table, awake ? static_cast<uint8_t>(chunk.next_rect.min_x - left) : 0);
+        put8(table, awake ? static_cast<uint8_t>(chunk.next_rect.min_y - top) : 0);
+        put8(table, awake ? static_cast<uint8_t>(chunk.next_rect.max_x - left) : 0);
+        put8(table, awake ? static_cast<uint8_t>(chunk.next_rect.max_y - top) : 0);
+        put16(table, 0);
+
+        if(awake) {
+            for(uint32_t row : chunk.next_queued_rows) {
+                put32(wake, row);
+            }
+        }
+    }
+
+    out.insert(out.end(), header.begin(), header.end());
+    out.insert(out.end(), table.begin(), table.end());
+    out.insert(out.end(), wake.begin(), wake.end());
+    out.insert(out.end(), data.begin(), data.end());
+    return true;
+}
+
+bool Grid::saveSnapshot(const std::string& path) {
+    std::vector<uint8_t> bytes;
+    if(!encodeSnapshot(bytes)) return false;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if(!file) return false;
+
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    return static_cast<bool>(file);
+}
+
+// Fill one chunk's cells from its encoded data, false if the data is malformed
+static bool decodeChunk(const uint8_t* in, size_t size, uint8_t encoding, uint8_t* types, uint8_t* chunk_shades, ParticleTypeData* chunk_payloads) {
+    auto readCell = [](const uint8_t* cell, uint8_t& type, uint8_t& shade, uint32_t& payload) {
+        type = cell[0];
+        shade = cell[1];
+        payload = get32(cell + 2);
+        return type < NUM_PARTICLE_TYPES;
+    };
+
+    uint8_t type, shade;
+    uint32_t payload;
+
+    if(encoding == CHUNK_EMPTY) {
+        return size == 0;  // init already cleared the cells
+    }else if(encoding == CHUNK_UNIFORM) {
+        if(size != CELL_SIZE || !readCell(in, type, shade, payload)) return false;
+
+        std::memset(types, type, ParticleChunk::CHUNK_AREA);
+        std::memset(chunk_shades, shade, ParticleChunk::CHUNK_AREA);
+        for(int i = 0; i < ParticleChunk::CHUNK_AREA; i++) {
+            chunk_payloads[i].raw = payload;
+        }
+        return true;
+    }else if(encoding == CHUNK_RUNS) {
+        int cell = 0;
+        for(size_t pos = 0; pos < size; pos += 2 + CELL_SIZE) {
+            if(pos + 2 + CELL_SIZE > size) return false;
+
+            int length = get16(in + pos);
+            if(length == 0 || cell + length > ParticleChunk::CHUNK_AREA) return false;
+            if(!readCell(in + pos + 2, type, shade, payload)) return false;
+
+            std::memset(types + cell, type, length);
+            std::memset(chunk_shades + cell, shade, length);
+            for(int i = cell; i < cell + length; i++) {
+                chunk_payloads[i].raw = payload;
+            }
+            cell += length;
+        }
+        return cell == ParticleChunk::CHUNK_AREA;
+    }
+    return false;
+}
+
+bool Grid::isSnapshotFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[4];
+    return file.read(magic, 4) && std::memcmp(magic, SNAPSHOT_MAGIC, 4) == 0;
+}
+
+bool Grid::loadSnapshot(const std::string& path) {
+    MappedFile file;
+    if(!file.open(path)) return false;
+
+    return decodeSnapshot(file.data(), file.size(), path);
+}
+
+bool Grid::decodeSnapshot(const uint8_t* bytes, size_t size, const std::string& source) {
+    if(size < HEADER_SIZE) return false;
+
+    if(std::memcmp(bytes, SNAPSHOT_MAGIC, 4) != 0) return false;
+    uint32_t version = get32(bytes + 4);
+    if(version < 1 || version > SNAPSHOT_VERSION) {
+        fprintf(stderr, "Unsupported snapshot version %u in %s\n", version, source.c_str());
+        return false;
+    }
+
+    uint32_t w = get32(bytes + 8);
+    uint32_t h = get32(bytes + 12);
+    uint64_t saved_seed = get64(bytes + 16);
+    uint64_t saved_tick = get64(bytes + 24);
+    uint32_t chunk_size = get32(bytes + 32);
+    uint32_t num_entries = get32(bytes + 36);
+
+    if(w == 0 || h == 0 || chunk_size != ParticleChunk::CHUNK_SIZE) return false;
+
+    // any world the Grid can hold: chunk indices are ints
+    uint64_t chunks_x = (static_cast<uint64_t>(w) + chunk_size - 1) / chunk_size;
+    uint64_t chunks_y = (static_cast<uint64_t>(h) + chunk_size - 1) / chunk_size;
+    if(w > INT_MAX - chunk_size || h > INT_MAX - chunk_size || chunks_x * chunks_y > INT_MAX) {
+        fprintf(stderr, "Snapshot %s is %ux%u, larger than a world can be (at most %d chunks)\n", source.c_str(), w, h, INT_MAX);
+        return false;
+    }
+    // versions 1 and 2 list every chunk, later ones the allocated chunks
+    bool dense = version < 3;
+    size_t entry_size = dense ? DENSE_TABLE_ENTRY_SIZE : TABLE_ENTRY_SIZE;
+    if((dense ? num_entries != chunks_x * chunks_y : num_entries > chunks_x * chunks_y) ||
+        size < HEADER_SIZE + entry_size * static_cast<size_t>(num_entries)) {
+        fprintf(stderr, "Truncated snapshot header in %s\n", source.c_str());
+        return false;
+    }
+
+    // every chunk's data has to lie inside the file before anything is touched.
+    // entry points at the fields from the offset on, which all versions share
+    struct StoredChunk {
+        int index;
+        const uint8_t* entry;
+    };
+    std::vector<StoredChunk> entries;
+    entries.reserve(num_entries);
+    const uint8_t* table = bytes + HEADER_SIZE;
+    size_t num_awake = 0;
+    for(uint32_t n = 0; n < num_entries; n++) {
+        const uint8_t* entry = table + n * entry_size;
+        uint64_t index = n;
+        if(!dense) {
+            index = get32(entry);
+            entry += 4;
+            if(index >= chunks_x * chunks_y || (n > 0 && static_cast<int>(index) <= entries.back().index)) {
+                fprintf(stderr, "Corrupt chunk table in snapshot %s\n", source.c_str());
+                return false;
+            }
+        }
+
+        uint64_t offset = get64(entry);
+        uint64_t length = get32(entry + 8);
+        if(offset > size || length > size - offset) {
+            fprintf(stderr, "Truncated chunk data in snapshot %s\n", source.c_str());
+            return false;
+        }
+        if(entry[13] != 0) num_awake++;
+        entries.push_back({static_cast<int>(index), entry});
+    }
+
+    const uint8_t* wake = table + entry_size * static_cast<size_t>(num_entries);
+    if(version >= 2 && static_cast<size_t>(bytes + size - wake) < WAKE_ROWS_SIZE * num_awake) {
+        fprintf(stderr, "Truncated wake state in snapshot %s\n", source.c_str());
+        return false;
+    }
+
+    init(static_cast<int>(w), static_cast<int>(h));
+    seed = saved_seed;
+    tick = saved_tick;
+
+    // empty chunks stay unallocated, the rest are allocated up front
+    std::vector<int> stored_chunks;
+    for(int n = 0; n < static_cast<int>(entries.size()); n++) {
+        const uint8_t* entry = entries[n].entry;
+        if(entry[12] == CHUNK_EMPTY) {
+            if(get32(entry + 8) != 0) {
+                fprintf(stderr, "Corrupt chunk data in snapshot %s\n", source.c_str());
+                init(static_cast<int>(w), static_cast<int>(h));
+                return false;
+            }
+            continue;
+        }
+        allocateChunk(entries[n].index);
+        stored_chunks.push_back(n);
+    }
+
+    // chunks are independent, decode them on all workers
+    std::atomic<bool> valid{true};
+    processing_threads.parallelFor(static_cast<int>(stored_chunks.size()), 16, [&](int begin, int end, int) {
+        for(int i = begin; i < end; i++) {
+            const StoredChunk& stored = entries[stored_chunks[i]];
+            ParticleChunk& chunk = *particleChunks[stored.index];
+
+            if(!decodeChunk(bytes + get64(stored.entry), get32(stored.entry + 8), stored.entry[12],
+                chunk.type_ids.data(), chunk.shades.data(), chunk.payloads.data())) {
+                valid = false;
+                continue;
+            }
+            chunk.rebuildTypeData();
+        }
+    });
+
+    if(!valid) {
+        fprintf(stderr, "Corrupt chunk data in snapshot %s\n", source.c_str());
+        init(static_cast<int>(w), static_cast<int>(h));
+        return false;
+    }
+
+    // restore what was woken for the next tick, in chunk order
+    for(const StoredChunk& stored : entries) {
+        const uint8_t* entry = stored.entry;
+        if(entry[13] == 0) continue;
+
+        int left = (stored.index % num_particle_chunks_x) * ParticleChunk::CHUNK_SIZE;
+        int top = (stored.index / num_particle_chunks_x) * ParticleChunk::CHUNK_SIZE;
+        if(version < 2) {
+            wakeArea(left + entry[14], top + entry[15], left + entry[16], top + entry[17]);
+            continue;
+        }
+
+        // each run of queued cells on a row
+        for(int row = 0; row < ParticleChunk::CHUNK_SIZE; row++) {
+            uint32_t cells = get32(wake + row * 4);
+            while(cells != 0) {
+                int first = __builtin_ctz(cells);
+                int length = __builtin_ctzll(~(static_cast<uint64_t>(cells) >> first));
+                wakeArea(left + first, top + row, left + first + length - 1, top + row);
+                cells &= ~static_cast<uint32_t>(((1ull << length) - 1) << first);
+            }
+        }
+        wake += WAKE_ROWS_SIZE;
+    }
+
+    return true;
+}
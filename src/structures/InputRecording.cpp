@@ -0,0 +1,256 @@
+#include "structures/InputRecording.h"
+#include "structures/Grid.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// Input recording, all fixed size integers little endian.
+//
+//  header   "FSRC", u32 version, u32 flags (1 = checkerboard update, 2 = liquid levelling,
+//           4 = bitboard update, 8 = material reactions), u64 snapshot size,
+//           then the starting world as a Grid snapshot
+//  blocks   one per tick that had strokes: varint ticks since the previous
+//           block (or the start), varint stroke count, then each stroke as
+//           u8 action, u8 type, varint radius, zigzag varint x, zigzag varint y
+//  end      varint ticks since the previous block, varint 0, u64 final checksum
+//
+// A recording without the end block was cut short, it replays up to its last stroke.
+// Version 1 strokes overwrote every cell, since version 2 they leave the cells
+// that already hold the material alone. Version 3 has the chunk checksum.
+// Older recordings no longer replay.
+
+static const char RECORDING_MAGIC[4] = {'F', 'S', 'R', 'C'};
+static const uint32_t RECORDING_VERSION = 3;
+static const size_t HEADER_SIZE = 20;
+static const uint32_t FLAG_CHECKERBOARD = 1 << 0;
+static const uint32_t FLAG_LIQUID_LEVELLING = 1 << 1;
+static const uint32_t FLAG_BITBOARD = 1 << 2;
+static const uint32_t FLAG_MATERIAL_REACTIONS = 1 << 3;
+
+static void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while(value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static void putSigned(std::vector<uint8_t>& out, int value) {
+    uint32_t bits = static_cast<uint32_t>(value);
+    putVarint(out, (bits << 1) ^ (value < 0 ? 0xffffffffu : 0));
+}
+
+static void putFixed(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+    for(int b = 0; b < bytes; b++) out.push_back(static_cast<uint8_t>(value >> (b * 8)));
+}
+
+static uint64_t getFixed(const uint8_t* in, int bytes) {
+    uint64_t value = 0;
+    for(int b = 0; b < bytes; b++) value |= static_cast<uint64_t>(in[b]) << (b * 8);
+    return value;
+}
+
+// Reads varints off a byte range, fails instead of reading past the end
+class VarintReader {
+    public:
+        VarintReader(const uint8_t* begin, const uint8_t* end) : pos(begin), end(end) {}
+
+        bool atEnd() const { return pos == end; }
+
+        bool read(uint64_t& value) {
+            value = 0;
+            for(int shift = 0; shift < 64; shift += 7) {
+                if(pos == end) return false;
+                uint8_t byte = *pos++;
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if((byte & 0x80) == 0) return true;
+            }
+            return false;
+        }
+
+        bool readSigned(int& value) {
+            uint64_t bits;
+            if(!read(bits) || bits > 0xffffffffu) return false;
+            value = static_cast<int>(static_cast<uint32_t>(bits >> 1) ^ (0u - static_cast<uint32_t>(bits & 1)));
+            return true;
+        }
+
+        bool readByte(uint8_t& value) {
+            if(pos == end) return false;
+            value = *pos++;
+            return true;
+        }
+
+        bool readFixed(uint64_t& value, int bytes) {
+            if(end - pos < bytes) return false;
+            value = getFixed(pos, bytes);
+            pos += bytes;
+            return true;
+        }
+
+    private:
+        const uint8_t* pos;
+        const uint8_t* end;
+};
+
+bool InputRecorder::open(const std::string& path) {
+    close();
+
+    std::vector<uint8_t> snapshot;
+    if(!Grid::encodeSnapshot(snapshot)) return false;
+
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if(!file) return false;
+
+    buffer.assign(RECORDING_MAGIC, RECORDING_MAGIC + 4);
+    putFixed(buffer, RECORDING_VERSION, 4);
+    uint32_t flags = (Grid::isCheckerboardUpdate() ? FLAG_CHECKERBOARD : 0) |
+        (Grid::isLiquidLevelling() ? FLAG_LIQUID_LEVELLING : 0) | (Grid::isBitboardUpdate() ? FLAG_BITBOARD : 0) |
+        (Grid::isMaterialReactions() ? FLAG_MATERIAL_REACTIONS : 0);
+    putFixed(buffer, flags, 4);
+    putFixed(buffer, snapshot.size(), 8);
+    file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    file.write(reinterpret_cast<const char*>(snapshot.data()), snapshot.size());
+
+    last_tick = Grid::tick;
+    pending_tick = Grid::tick;
+    pending.clear();
+    return static_cast<bool>(file);
+}
+
+void InputRecorder::record(const BrushCommand& command) {
+    if(!file.is_open()) return;
+
+    if(Grid::tick != pending_tick) {
+        writePending();
+        pending_tick = Grid::tick;
+    }
+    pending.push_back(command);
+}
+
+void InputRecorder::writePending() {
+    if(pending.empty()) return;
+
+    buffer.clear();
+    putVarint(buffer, pending_tick - last_tick);
+    putVarint(buffer, pending.size());
+    for(const BrushCommand& command : pending) {
+        buffer.push_back(static_cast<uint8_t>(command.action));
+        buffer.push_back(static_cast<uint8_t>(command.type));
+        putVarint(buffer, static_cast<uint32_t>(std::max(command.radius, 0)));
+        putSigned(buffer, command.x);
+        putSigned(buffer, command.y);
+    }
+    file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+
+    last_tick = pending_tick;
+    pending.clear();
+}
+
+bool InputRecorder::close() {
+    if(!file.is_open()) return false;
+
+    writePending();
+
+    buffer.clear();
+    putVarint(buffer, Grid::tick - last_tick);
+    putVarint(buffer, 0);
+    putFixed(buffer, Grid::computeChecksum(), 8);
+    file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+
+    bool written = static_cast<bool>(file);
+    file.close();
+    return written;
+}
+
+bool InputReplay::open(const std::string& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if(!file) return false;
+
+    std::vector<uint8_t> bytes(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    if(!file.read(reinterpret_cast<char*>(bytes.data()), bytes.size())) return false;
+
+    if(bytes.size() < HEADER_SIZE || std::memcmp(bytes.data(), RECORDING_MAGIC, 4) != 0) {
+        fprintf(stderr, "Not an input recording: %s\n", path.c_str());
+        return false;
+    }
+    if(getFixed(bytes.data() + 4, 4) != RECORDING_VERSION) {
+        fprintf(stderr, "Unsupported recording version %u in %s\n", static_cast<uint32_t>(getFixed(bytes.data() + 4, 4)), path.c_str());
+        return false;
+    }
+
+    uint32_t flags = static_cast<uint32_t>(getFixed(bytes.data() + 8, 4));
+    checkerboard = (flags & FLAG_CHECKERBOARD) != 0;
+    liquid_levelling = (flags & FLAG_LIQUID_LEVELLING) != 0;
+    bitboard = (flags & FLAG_BITBOARD) != 0;
+    material_reactions = (flags & FLAG_MATERIAL_REACTIONS) != 0;
+    uint64_t snapshot_size = getFixed(bytes.data() + 12, 8);
+    if(snapshot_size > bytes.size() - HEADER_SIZE ||
+        !Grid::decodeSnapshot(bytes.data() + HEADER_SIZE, snapshot_size, path)) {
+        fprintf(stderr, "Bad starting world in recording %s\n", path.c_str());
+        return false;
+    }
+
+    start_tick = Grid::tick;
+    end_tick = start_tick;
+    complete = false;
+    ticks.clear();
+    commands.clear();
+    next_input = 0;
+
+    VarintReader reader(bytes.data() + HEADER_SIZE + snapshot_size, bytes.data() + bytes.size());
+    uint64_t tick = start_tick;
+    while(!reader.atEnd()) {
+        uint64_t delta, count;
+        if(!reader.read(delta) || !reader.read(count)) break;
+        tick += delta;
+
+        if(count == 0) {
+            complete = reader.readFixed(expected_checksum, 8);
+            end_tick = tick;
+            break;
+        }
+
+        TickInput input = {tick, static_cast<int>(commands.size()), 0};
+        for(uint64_t i = 0; i < count; i++) {
+            uint8_t action, type;
+            uint64_t radius;
+            BrushCommand command;
+            if(!reader.readByte(action) || !reader.readByte(type) || !reader.read(radius) ||
+                !reader.readSigned(command.x) || !reader.readSigned(command.y)) break;
+            if(action > static_cast<uint8_t>(BrushAction::REMOVE) || type >= NUM_PARTICLE_TYPES || radius > 0xffff) break;
+
+            command.action = static_cast<BrushAction>(action);
+            command.type = static_cast<ParticleTypeID>(type);
+            command.radius = static_cast<int>(radius);
+            commands.push_back(command);
+            input.count++;
+        }
+        if(input.count > 0) {
+            ticks.push_back(input);
+        }
+        if(static_cast<uint64_t>(input.count) != count) break;  // cut off mid block
+    }
+
+    // a recording that was cut short ends with its last strokes
+    if(!complete) {
+        if(!ticks.empty()) end_tick = ticks.back().tick + 1;
+        fprintf(stderr, "Recording %s ends early, replaying up to tick %llu\n", path.c_str(), static_cast<unsigned long long>(end_tick));
+    }
+    return true;
+}
+
+bool InputReplay::applyTick() {
+    if(Grid::tick >= end_tick) return false;
+
+    while(next_input < ticks.size() && ticks[next_input].tick <= Grid::tick) {
+        const TickInput& input = ticks[next_input++];
+        if(input.tick != Grid::tick) continue;
+
+        for(int i = input.first; i < input.first + input.count; i++) {
+            Brush::apply(commands[i]);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,82 @@
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "structures/Brush.h"
+
+#ifndef INPUT_RECORDING_H
+#define INPUT_RECORDING_H
+
+// Brush strokes recorded against the Grid, so a session can be replayed
+// exactly. The behaviors' random numbers only depend on the seed and the tick,
+// so the starting world (which carries the seed) and the strokes painted
+// before each tick are all a replay needs. See InputRecording.cpp for the format.
+
+// Writes a recording, on the thread that owns the Grid
+class InputRecorder {
+public:
+    ~InputRecorder() {
+        close();
+    }
+
+    // Start a recording of the Grid as it is now. false if the file can't be written
+    bool open(const std::string& path);
+    // Finish with the final tick and checksum, so a replay can check it ended up the same
+    bool close();
+    bool isOpen() const { return file.is_open(); }
+
+    // A stroke painted before the tick Grid::tick is about to run
+    void record(const BrushCommand& command);
+
+private:
+    std::ofstream file;
+    uint64_t last_tick = 0;     // tick of the last block written
+    uint64_t pending_tick = 0;  // tick the pending strokes belong to
+    std::vector<BrushCommand> pending;
+    std::vector<uint8_t> buffer;
+
+    void writePending();
+};
+
+// Plays a recording back into the Grid
+class InputReplay {
+public:
+    // Load the starting world into the Grid and read every stroke.
+    // false if the file is missing or malformed
+    bool open(const std::string& path);
+
+    bool isCheckerboard() const { return checkerboard; }
+    bool isLiquidLevelling() const { return liquid_levelling; }
+    bool isBitboard() const { return bitboard; }
+    bool isMaterialReactions() const { return material_reactions; }
+    uint64_t getStartTick() const { return start_tick; }
+    uint64_t getEndTick() const { return end_tick; }
+    // a recording cut short (the game crashed) has no final checksum
+    bool isComplete() const { return complete; }
+    uint64_t getExpectedChecksum() const { return expected_checksum; }
+
+    // Paint the strokes recorded for the tick Grid::tick is about to run.
+    // false once the recording is over
+    bool applyTick();
+
+private:
+    struct TickInput {
+        uint64_t tick;
+        int first, count;   // range in commands
+    };
+
+    std::vector<TickInput> ticks;
+    std::vector<BrushCommand> commands;
+    size_t next_input = 0;
+
+    bool checkerboard = false;
+    bool liquid_levelling = false;
+    bool bitboard = false;
+    bool material_reactions = false;
+    bool complete = false;
+    uint64_t start_tick = 0;
+    uint64_t end_tick = 0;
+    uint64_t expected_checksum = 0;
+};
+
+#endif // INPUT_RECORDING_H
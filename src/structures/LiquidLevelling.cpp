@@ -0,0 +1,154 @@
+#include "structures/Grid.h"
+#include "structures/ParticleChunk.h"
+#include "particles/ParticleType.h"
+#include <algorithm>
+#include <vector>
+
+// Liquid levelling. After every sweep each body of liquid in an active chunk
+// is flood filled, and the top cell of its highest columns moves straight to
+// the lowest supported empty cell next to the body. Cells only move down, one
+// per column per pass, so connected vessels settle at the same level.
+
+bool Grid::liquid_levelling = true;
+uint32_t Grid::level_pass = 0;
+
+struct LevelCell {
+    int x, y;
+};
+
+// scratch space reused by every body
+static std::vector<LevelCell> body_stack;
+static std::vector<LevelCell> sources;
+static std::vector<LevelCell> sinks;
+
+void Grid::setLiquidLevelling(bool enabled) {
+    liquid_levelling = enabled;
+}
+
+bool Grid::isLiquidLevelling() {
+    return liquid_levelling;
+}
+
+// Mark a liquid cell as part of a body this pass, false if it already was
+static inline bool visitLiquid(ParticleChunk& chunk, int x, int y, uint32_t pass) {
+    if(chunk.level_pass != pass) {
+        chunk.level_pass = pass;
+        chunk.level_visited.fill(0);
+    }
+
+    uint32_t& row = chunk.level_visited[y & ParticleChunk::CHUNK_MASK];
+    uint32_t bit = 1u << (x & ParticleChunk::CHUNK_MASK);
+    if(row & bit) return false;
+
+    row |= bit;
+    return true;
+}
+
+// An empty cell liquid would stay in: resting on something or the bottom of the grid
+static inline bool isRestingPlace(int x, int y) {
+    if(!Grid::isInBounds(x, y) || !Grid::isCellEmpty(x, y)) return false;
+    return y + 1 >= Grid::height || !Grid::isCellEmpty(x, y + 1);
+}
+
+void Grid::levelLiquids() {
+    level_pass++;
+
+    // only bodies in active chunks
+    for(int index : active_chunks) {
+        ParticleChunk& chunk = *particleChunks[index];
+        if(chunk.rect.isEmpty()) continue;
+
+        bool has_liquid = false;
+        for(int type = 0; type < NUM_PARTICLE_TYPES; type++) {
+            if(chunk.hasParticleType(static_cast<ParticleTypeID>(type)) &&
+                ParticleTypeRegistry::getState(static_cast<ParticleTypeID>(type)) == MatterState::LIQUID) {
+                has_liquid = true;
+            }
+        }
+        if(!has_liquid) continue;
+
+        // bodies are found from their queued cells, the fill takes in the rest
+        DirtyRect rect = chunk.rect;
+        int left = chunk.x * ParticleChunk::CHUNK_SIZE;
+        for(int y = rect.min_y; y <= rect.max_y; y++) {
+            for(uint32_t cells = chunk.queued_rows[y & ParticleChunk::CHUNK_MASK]; cells != 0; cells &= cells - 1) {
+                int x = left + __builtin_ctz(cells);
+                ParticleTypeID type = static_cast<ParticleTypeID>(chunk.type_ids[ParticleChunk::getLocalIndex(x, y)]);
+                if(ParticleTypeRegistry::getState(type) != MatterState::LIQUID) continue;
+                if(chunk.level_pass == level_pass &&
+                    (chunk.level_visited[y & ParticleChunk::CHUNK_MASK] >> (x & ParticleChunk::CHUNK_MASK)) & 1) continue;
+
+                last_tick_stats.levelled += levelBody(x, y, type);
+            }
+        }
+    }
+}
+
+// Flood fill the body of liquid containing (x, y) and level it, returns the cells moved
+int Grid::levelBody(int start_x, int start_y, ParticleTypeID type) {
+    body_stack.clear();
+    sources.clear();
+    sinks.clear();
+
+    visitLiquid(getParticleChunk(start_x, start_y), start_x, start_y, level_pass);
+    body_stack.push_back({start_x, start_y});
+
+    int body_size = 0;
+    while(!body_stack.empty()) {
+        LevelCell cell = body_stack.back();
+        body_stack.pop_back();
+        body_size++;
+
+        // the top of a column, liquid can be taken from here
+        if(cell.y > 0 && isCellEmpty(cell.x, cell.y - 1)) {
+            sources.push_back(cell);
+        }
+
+        static const int NEIGHBOR_DX[4] = {-1, 1, 0, 0};
+        static const int NEIGHBOR_DY[4] = {0, 0, -1, 1};
+        for(int n = 0; n < 4; n++) {
+            int x = cell.x + NEIGHBOR_DX[n];
+            int y = cell.y + NEIGHBOR_DY[n];
+            if(!isInBounds(x, y)) continue;
+
+            ParticleTypeID neighbor = getType(x, y);
+            if(neighbor == type) {
+                // very large bodies are only levelled around where the fill started
+                if(body_size + static_cast<int>(body_stack.size()) >= LEVEL_MAX_BODY) continue;
+                if(visitLiquid(getParticleChunk(x, y), x, y, level_pass)) {
+                    body_stack.push_back({x, y});
+                }
+            }else if(neighbor == ParticleTypeID::EMPTY && isRestingPlace(x, y)) {
+                sinks.push_back({x, y});
+            }
+        }
+    }
+
+    if(sources.empty() || sinks.empty()) return 0;
+
+    // highest sources and lowest sinks first. Ties alternate sides every tick
+    // so a body doesn't lean to the left
+    bool flip = (tick & 1) != 0;
+    auto byColumn = [flip](const LevelCell& a, const LevelCell& b) {
+        return flip ? a.x > b.x : a.x < b.x;
+    };
+    std::sort(sources.begin(), sources.end(), [&](const LevelCell& a, const LevelCell& b) {
+        return a.y != b.y ? a.y < b.y : byColumn(a, b);
+    });
+    std::sort(sinks.begin(), sinks.end(), [&](const LevelCell& a, const LevelCell& b) {
+        return a.y != b.y ? a.y > b.y : byColumn(a, b);
+    });
+
+    int moved = 0;
+    size_t sink = 0;
+    for(const LevelCell& source : sources) {
+        // the same empty cell can sit next to several body cells
+        while(sink < sinks.size() && !isCellEmpty(sinks[sink].x, sinks[sink].y)) sink++;
+        if(sink == sinks.size() || sinks[sink].y <= source.y) break;
+
+        swapParticles(source.x, source.y, sinks[sink].x, sinks[sink].y);
+        sink++;
+        moved++;
+    }
+    return moved;
+}
@@ -8,20 +8,21 @@ bool ParticleChunk::hasParticleType(ParticleTypeID type) const {
 
 void ParticleChunk::rebuildTypeData() {
 
+    type_counts.fill(0);
     type_bitmask = 0;
-    
-    // Scan this chunk's particles, plus a border of 1 cell.
-    int start_x = std::max(x * CHUNK_SIZE - 1, 0);
-    int start_y = std::max(y * CHUNK_SIZE - 1, 0);
-    int end_x = std::min(start_x + CHUNK_SIZE + 1, Grid::width);
-    int end_y = std::min(start_y + CHUNK_SIZE + 1, Grid::height);
 
-    for(int py = start_y; py < end_y; py++) {
-        for(int px = start_x; px < end_x; px++) {
-            ParticleTypeID type = Grid::getParticle(px, py).type_id;
-            type_bitmask |= (1 << static_cast<int>(type));
+    // Scan this chunk's particles, edge chunks stop at the grid border
+    int left = x * CHUNK_SIZE, top = y * CHUNK_SIZE;
+    int end_x = std::min(left + CHUNK_SIZE, Grid::width) - left;
+    int end_y = std::min(top + CHUNK_SIZE, Grid::height) - top;
+
+    for(int py = 0; py < end_y; py++) {
+        uint32_t solid = 0;
+        for(int px = 0; px < end_x; px++) {
+            ParticleTypeID type = static_cast<ParticleTypeID>(type_ids[getLocalIndex(px, py)]);
+            addType(type);
+            if(ParticleTypeRegistry::getState(type) == MatterState::SOLID) solid |= 1u << px;
         }
+        solid_rows[py].store(solid, std::memory_order_relaxed);
     }
-    
-    type_data_valid = true;
-}
\ No newline at end of file
+}
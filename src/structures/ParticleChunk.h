@@ -1,26 +1,129 @@
-#include <SDL3/SDL_render.h>
 #include <array>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include "particles/ParticleType.h"
 
 
 #ifndef PARTICLE_CHUNK_H
 #define PARTICLE_CHUNK_H
 
+// Inclusive rectangle of grid cells, empty when min > max
+struct DirtyRect{
+    int min_x = 1, min_y = 1;
+    int max_x = 0, max_y = 0;
+
+    bool isEmpty() const {
+        return min_x > max_x || min_y > max_y;
+    }
+
+    bool containsRow(int y) const {
+        return y >= min_y && y <= max_y;
+    }
+
+    void include(int x0, int y0, int x1, int y1) {
+        if(isEmpty()) {
+            min_x = x0; min_y = y0;
+            max_x = x1; max_y = y1;
+            return;
+        }
+        min_x = std::min(min_x, x0);
+        min_y = std::min(min_y, y0);
+        max_x = std::max(max_x, x1);
+        max_y = std::max(max_y, y1);
+    }
+
+    void clear() {
+        *this = DirtyRect();
+    }
+};
+
+// A 32x32 tile of the Grid. Chunks are only allocated once something is placed
+// in them, the cells of every other chunk read as empty.
 struct ParticleChunk{
-    SDL_Texture* texture = nullptr;
     mutable bool dirty = true;
-    mutable bool type_data_valid = false;
     mutable bool shouldProcessNextFrame = false;
     mutable bool shouldProcess = false;
 
-    int x, y;
+    int x = 0, y = 0;
     static const int CHUNK_SIZE = 32;  // Size of each chunk in grid cells
+    static const int CHUNK_SHIFT = 5;  // log2(CHUNK_SIZE)
+    static const int CHUNK_MASK = CHUNK_SIZE - 1;
+    static const int CHUNK_AREA = CHUNK_SIZE * CHUNK_SIZE;  // cells stored per chunk
+
+    // cells to simulate this tick, and the cells woken so far for the next one,
+    // one bit per cell of each row. The rects bound the queued cells
+    std::array<uint32_t, CHUNK_SIZE> queued_rows{};
+    std::array<uint32_t, CHUNK_SIZE> next_queued_rows{};
+    DirtyRect rect;
+    DirtyRect next_rect;
+
+    // last tick the chunk was simulated or allocated, empty chunks are given
+    // back a while after that so a chunk on the edge of a pile isn't
+    // allocated and freed every tick
+    uint64_t last_used_tick = 0;
+    int allocated_slot = -1;  // position in Grid's list of allocated chunks
+    bool free_candidate = false;  // already in Grid's list of chunks to check for freeing
+
+    // liquid cells already flood filled by Grid::levelLiquids(), one bit per
+    // cell of each row. Only valid while level_pass matches Grid's
+    uint32_t level_pass = 0;
+    std::array<uint32_t, CHUNK_SIZE> level_visited{};
 
+    // number of cells of each type inside the chunk, kept up to date by Grid
+    // on every write. type_bitmask has a bit set for each non zero count
+    std::array<uint16_t, NUM_PARTICLE_TYPES> type_counts{};
     mutable uint32_t type_bitmask = 0;
 
+    // one bit per cell of each row, set where the cell holds a solid, for
+    // Grid::getSolidRow(). Workers can write cells on the same row of a
+    // neighbor chunk from both sides, so the rows are atomic
+    std::array<std::atomic<uint32_t>, CHUNK_SIZE> solid_rows{};
+
+    // the cells, one array per field, indexed by getLocalIndex()
+    std::array<uint8_t, CHUNK_AREA> type_ids{};
+    std::array<uint8_t, CHUNK_AREA> shades{};
+    std::array<ParticleTypeData, CHUNK_AREA> payloads{};
+
+    // tick stamps, see Grid::current_stamp
+    std::array<uint8_t, CHUNK_AREA> changed_stamps{};
+    std::array<uint8_t, CHUNK_AREA> updated_stamps{};
+
+    static inline int getLocalIndex(int px, int py) {
+        return ((py & CHUNK_MASK) << CHUNK_SHIFT) | (px & CHUNK_MASK);
+    }
+
     bool hasParticleType(ParticleTypeID type) const;
 
+    // Queue the cells of an inclusive rectangle inside the chunk, in grid coordinates
+    static inline void queueCells(std::array<uint32_t, CHUNK_SIZE>& rows, DirtyRect& bounds, int x0, int y0, int x1, int y1) {
+        uint32_t bits = (~0u << (x0 & CHUNK_MASK)) & (~0u >> (CHUNK_MASK - (x1 & CHUNK_MASK)));
+        for(int y = y0; y <= y1; y++) {
+            rows[y & CHUNK_MASK] |= bits;
+        }
+        bounds.include(x0, y0, x1, y1);
+    }
+
+    // true when every cell is empty, and the chunk can be given back
+    bool isEmpty() const {
+        return type_bitmask == (1u << static_cast<int>(ParticleTypeID::EMPTY)) || type_bitmask == 0;
+    }
+
+    inline void addType(ParticleTypeID type) {
+        if(type_counts[type]++ == 0) {
+            type_bitmask |= 1 << static_cast<int>(type);
+        }
+    }
+
+    inline void removeType(ParticleTypeID type) {
+        if(--type_counts[type] == 0) {
+            type_bitmask &= ~(1 << static_cast<int>(type));
+        }
+    }
+
+    // Recount every cell inside the grid and redo the solid rows, needed after
+    // writing the cells directly
     void rebuildTypeData();
 };
 
-#endif
\ No newline at end of file
+#endif
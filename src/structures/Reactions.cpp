@@ -0,0 +1,142 @@
+#include "structures/Grid.h"
+#include "structures/ParticleChunk.h"
+#include "particles/ParticleFactory.h"
+#include "particles/Reaction.h"
+#include <algorithm>
+#include <array>
+
+// Material reactions, from the table in Reaction.h. After every sweep each
+// queued cell of a material with reactions rolls the chance of its first
+// reaction that has a neighbor to react with, and stays queued if it misses.
+
+bool Grid::material_reactions = true;
+
+// materials with at least one reaction
+static constexpr uint32_t makeReactiveTypes() {
+    uint32_t types = 0;
+    for(int type = 0; type < NUM_PARTICLE_TYPES; type++) {
+        if(REACTS_WITH[type] != 0) types |= 1u << type;
+    }
+    return types;
+}
+
+static constexpr uint32_t REACTIVE_TYPES = makeReactiveTypes();
+
+void Grid::setMaterialReactions(bool enabled) {
+    material_reactions = enabled;
+}
+
+bool Grid::isMaterialReactions() {
+    return material_reactions;
+}
+
+// the neighbors in the order reactCell() reads them
+static const int NEIGHBOR_DX[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+static const int NEIGHBOR_DY[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+
+static inline int getMoisture(int x, int y, ParticleTypeID type) {
+    return type == ParticleTypeID::WET_SAND ? Grid::getData(x, y).wet_sand.moisture : 0;
+}
+
+// Turn the cell at (x, y) from one material into another and add to its moisture
+static void changeCell(int x, int y, ParticleTypeID from, ParticleTypeID to, int moisture, Random::CellRandom& rng) {
+    if(to == ParticleTypeID::EMPTY) {
+        Grid::removeParticle(x, y);
+        return;
+    }
+    if(to != from) {
+        Grid::setParticle(x, y, ParticleFactory::createParticle(to, rng.next()));
+    }
+    if(to == ParticleTypeID::WET_SAND) {
+        ParticleTypeData& data = Grid::getData(x, y);
+        data.wet_sand.moisture = static_cast<uint8_t>(std::clamp(data.wet_sand.moisture + moisture, 0, 255));
+    }
+    // moisture only matters to the reactions next door, the behaviors don't read it
+    if(to == from) {
+        Grid::markChanged(x, y);
+        Grid::getParticleChunk(x, y).dirty = true;
+        Grid::wakeArea(x - 1, y - 1, x + 1, y + 1);
+    }
+}
+
+// Run the first reaction of the cell at (x, y) that has a neighbor to react
+// with, true if it fired
+bool Grid::reactCell(int x, int y, ParticleTypeID type) {
+    // the 8 neighbors once, cells outside the grid react with nothing
+    std::array<uint8_t, 8> around;
+    uint32_t around_types = 0;
+    int n = 0;
+    for(int dy = -1; dy <= 1; dy++) {
+        for(int dx = -1; dx <= 1; dx++) {
+            if(dx == 0 && dy == 0) continue;
+            around[n] = isInBounds(x + dx, y + dy) ? getType(x + dx, y + dy) : NUM_PARTICLE_TYPES;
+            around_types |= 1u << around[n];
+            n++;
+        }
+    }
+    if(!(REACTS_WITH[type] & around_types)) return false;
+
+    int moisture = getMoisture(x, y, type);
+    for(const Reaction& reaction : REACTIONS) {
+        if(reaction.material != type || !(around_types & (1u << reaction.with))) continue;
+        if(moisture < reaction.min_moisture || moisture > reaction.max_moisture) continue;
+
+        int found[8];
+        int count = 0;
+        for(int i = 0; i < 8; i++) {
+            if(around[i] != reaction.with) continue;
+            if(reaction.to_drier && moisture < getMoisture(x + NEIGHBOR_DX[i], y + NEIGHBOR_DY[i], reaction.with) + 2) continue;
+            found[count++] = i;
+        }
+        if(count == 0) continue;
+
+        Random::CellRandom rng = random(x, y, Random::STREAM_REACTION);
+        if(rng.nextBelow(256) >= reaction.chance) {
+            wakeArea(x, y, x, y);  // try again next tick
+            return false;
+        }
+
+        int pick = found[rng.nextBelow(count)];
+        changeCell(x + NEIGHBOR_DX[pick], y + NEIGHBOR_DY[pick], reaction.with, reaction.with_becomes, reaction.with_moisture, rng);
+        changeCell(x, y, type, reaction.becomes, reaction.moisture, rng);
+        return true;
+    }
+    return false;
+}
+
+void Grid::runReactions() {
+    for(int index : active_chunks) {
+        ParticleChunk& chunk = *particleChunks[index];
+
+        // the materials here that react with something here or next door
+        uint32_t types = chunk.type_bitmask & REACTIVE_TYPES;
+        if(types == 0) continue;
+
+        uint32_t near_types = 0;
+        for(int chunk_y = std::max(chunk.y - 1, 0); chunk_y <= std::min(chunk.y + 1, num_particle_chunks_y - 1); chunk_y++) {
+            for(int chunk_x = std::max(chunk.x - 1, 0); chunk_x <= std::min(chunk.x + 1, num_particle_chunks_x - 1); chunk_x++) {
+                near_types |= particleChunks[chunk_y * num_particle_chunks_x + chunk_x]->type_bitmask;
+            }
+        }
+        uint32_t reacting = 0;
+        for(uint32_t bits = types; bits != 0; bits &= bits - 1) {
+            int type = __builtin_ctz(bits);
+            if(REACTS_WITH[type] & near_types) reacting |= 1u << type;
+        }
+        if(reacting == 0) continue;
+
+        int left = chunk.x * ParticleChunk::CHUNK_SIZE;
+        int top = chunk.y * ParticleChunk::CHUNK_SIZE;
+        int bottom = std::min(top + ParticleChunk::CHUNK_SIZE, height) - 1;
+        for(int y = bottom; y >= top; y--) {
+            int row_start = (y & ParticleChunk::CHUNK_MASK) * ParticleChunk::CHUNK_SIZE;
+            for(uint32_t cells = chunk.queued_rows[y & ParticleChunk::CHUNK_MASK]; cells != 0; cells &= cells - 1) {
+                int bit = __builtin_ctz(cells);
+                ParticleTypeID type = static_cast<ParticleTypeID>(chunk.type_ids[row_start + bit]);
+                if(!(reacting & (1u << type))) continue;
+
+                if(reactCell(left + bit, y, type)) last_tick_stats.reacted++;
+            }
+        }
+    }
+}
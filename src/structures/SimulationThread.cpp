@@ -0,0 +1,210 @@
+#include "structures/SimulationThread.h"
+#include "structures/Grid.h"
+#include "util/Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+
+void SimulationThread::start(int interval_ms, const std::string& path) {
+    stop();
+
+    tick_interval_ms = std::max(interval_ms, 1);
+    record_path = path;
+    brush = BrushCommand();
+    view_versions.clear();
+    view_chunks.clear();
+    view_indices.clear();
+    running = true;
+    thread = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop() {
+    running = false;
+    if(thread.joinable()) {
+        thread.join();
+    }
+}
+
+bool SimulationThread::sendBrush(const BrushCommand& command) {
+    return brush_commands.push(command);
+}
+
+void SimulationThread::setDebugInfo(bool enabled) {
+    debug_info = enabled;
+}
+
+void SimulationThread::setView(int x, int y, int width, int height) {
+    auto pack = [](int high, int low) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(std::max(high, 0))) << 32) | static_cast<uint32_t>(std::max(low, 0));
+    };
+    view_corner = pack(x, y);
+    view_size = pack(width, height);
+}
+
+const FrameSnapshot& SimulationThread::acquireFrame() {
+    frames.consume();
+    return frames.front();
+}
+
+bool SimulationThread::popTickProfile(TickProfile& profile) {
+    return tick_profiles.pop(profile);
+}
+
+void SimulationThread::run() {
+    using Clock = std::chrono::steady_clock;
+    const Clock::duration interval = std::chrono::milliseconds(tick_interval_ms);
+
+    if(!record_path.empty() && !recorder.open(record_path)) {
+        fprintf(stderr, "Couldn't record to %s\n", record_path.c_str());
+    }
+
+    // show the world before the first tick
+    publishFrame();
+
+    Clock::time_point next_tick = Clock::now() + interval;
+    while(running) {
+        TickProfile profile;
+        profile.tick = Grid::tick;
+
+        // every command is painted once, so a click shorter than a tick still
+        // lands, then a held brush keeps painting every tick
+        uint64_t start = Profiler::now();
+        bool painted = false;
+        BrushCommand command;
+        while(brush_commands.pop(command)) {
+            brush = command;
+            if(brush.action != BrushAction::NONE) {
+                applyBrush();
+                painted = true;
+            }
+        }
+        if(!painted && brush.action != BrushAction::NONE) {
+            applyBrush();
+        }
+        profile.brush_ns = Profiler::now() - start;
+
+        Grid::processParticles();
+        profile.stats = Grid::getLastTickStats();
+
+        start = Profiler::now();
+        profile.published_chunks = publishFrame();
+        profile.publish_ns = Profiler::now() - start;
+        tick_profiles.push(profile);
+
+        // when ticks take longer than the interval, drop the backlog instead of
+        // running flat out to catch up
+        Clock::time_point now = Clock::now();
+        next_tick += interval;
+        if(next_tick + 4 * interval < now) {
+            next_tick = now;
+        }
+        std::this_thread::sleep_until(next_tick);
+    }
+
+    if(recorder.isOpen() && !recorder.close()) {
+        fprintf(stderr, "Couldn't finish recording %s\n", record_path.c_str());
+    }
+}
+
+void SimulationThread::applyBrush() {
+    recorder.record(brush);
+    Brush::apply(brush);
+}
+
+// Copy the chunks in view that changed since this slot was last filled, then
+// hand it to the reader. Only the chunks in view are looked at, however large
+// the world is
+int SimulationThread::publishFrame() {
+    publish_count++;
+
+    uint64_t corner = view_corner.load();
+    uint64_t size = view_size.load();
+    int view_x = static_cast<int>(corner >> 32), view_y = static_cast<int>(corner & 0xffffffffu);
+    int view_width = static_cast<int>(size >> 32), view_height = static_cast<int>(size & 0xffffffffu);
+
+    // the chunks in view, clamped to the world
+    int first_x = std::min(view_x, Grid::width - 1) >> ParticleChunk::CHUNK_SHIFT;
+    int first_y = std::min(view_y, Grid::height - 1) >> ParticleChunk::CHUNK_SHIFT;
+    int last_x = (std::min(view_x + view_width, Grid::width) - 1) >> ParticleChunk::CHUNK_SHIFT;
+    int last_y = (std::min(view_y + view_height, Grid::height) - 1) >> ParticleChunk::CHUNK_SHIFT;
+    int chunks_x = view_width > 0 ? std::max(last_x - first_x + 1, 0) : 0;
+    int chunks_y = view_height > 0 ? std::max(last_y - first_y + 1, 0) : 0;
+    int num_chunks = chunks_x * chunks_y;
+
+    if(static_cast<int>(view_versions.size()) != num_chunks) {
+        view_versions.assign(num_chunks, publish_count);
+        view_chunks.assign(num_chunks, nullptr);
+        view_indices.assign(num_chunks, -1);
+    }
+    for(int slot = 0; slot < num_chunks; slot++) {
+        int index = (first_y + slot / chunks_x) * Grid::num_particle_chunks_x + first_x + slot % chunks_x;
+
+        // a chunk that scrolled into this slot, or was allocated or freed
+        // since the last frame, changed too
+        ParticleChunk* chunk = Grid::particleChunks[index];
+        if(index != view_indices[slot] || chunk != view_chunks[slot]) {
+            view_indices[slot] = index;
+            view_chunks[slot] = chunk;
+            view_versions[slot] = publish_count;
+        }
+        if(Grid::isChunkAllocated(index) && chunk->dirty) {
+            chunk->dirty = false;
+            view_versions[slot] = publish_count;
+        }
+    }
+
+    FrameSnapshot& frame = frames.back();
+    if(frame.chunks_x != chunks_x || frame.chunks_y != chunks_y) {
+        size_t num_cells = static_cast<size_t>(num_chunks) * ParticleChunk::CHUNK_AREA;
+        frame.chunks_x = chunks_x;
+        frame.chunks_y = chunks_y;
+        frame.type_ids.assign(num_cells, 0);
+        frame.shades.assign(num_cells, 0);
+        frame.payloads.assign(num_cells, ParticleTypeData{});
+        frame.chunk_versions.assign(num_chunks, 0);
+    }
+    frame.origin_x = first_x * ParticleChunk::CHUNK_SIZE;
+    frame.origin_y = first_y * ParticleChunk::CHUNK_SIZE;
+    frame.width = num_chunks == 0 ? 0 : std::min(chunks_x * ParticleChunk::CHUNK_SIZE, Grid::width - frame.origin_x);
+    frame.height = num_chunks == 0 ? 0 : std::min(chunks_y * ParticleChunk::CHUNK_SIZE, Grid::height - frame.origin_y);
+    frame.tick = Grid::tick;
+
+    int copied = 0;
+    for(int slot = 0; slot < num_chunks; slot++) {
+        if(frame.chunk_versions[slot] == view_versions[slot]) continue;
+        copied++;
+
+        int index = view_indices[slot];
+        size_t base = static_cast<size_t>(slot) * ParticleChunk::CHUNK_AREA;
+        std::memcpy(frame.type_ids.data() + base, Grid::getChunkTypes(index), ParticleChunk::CHUNK_AREA);
+        std::memcpy(frame.shades.data() + base, Grid::getChunkShades(index), ParticleChunk::CHUNK_AREA);
+        std::memcpy(frame.payloads.data() + base, Grid::getChunkPayloads(index), ParticleChunk::CHUNK_AREA * sizeof(ParticleTypeData));
+        frame.chunk_versions[slot] = view_versions[slot];
+    }
+
+    frame.debug_flags.clear();
+    frame.active_rects.clear();
+    if(debug_info) {
+        frame.debug_flags.assign(frame.type_ids.size(), 0);
+        for(int y = 0; y < frame.height; y++) {
+            for(int x = 0; x < frame.width; x++) {
+                uint8_t flags = 0;
+                if(Grid::hasChanged(frame.origin_x + x, frame.origin_y + y)) flags |= FrameSnapshot::DEBUG_CHANGED;
+                if(Grid::receivedUpdate(frame.origin_x + x, frame.origin_y + y)) flags |= FrameSnapshot::DEBUG_UPDATED;
+                frame.debug_flags[frame.getIndex(x, y)] = flags;
+            }
+        }
+        for(int slot = 0; slot < num_chunks; slot++) {
+            const DirtyRect& rect = view_chunks[slot]->rect;
+            if(view_chunks[slot]->shouldProcess && !rect.isEmpty()) {
+                frame.active_rects.push_back({rect.min_x - frame.origin_x, rect.min_y - frame.origin_y,
+                    rect.max_x - frame.origin_x, rect.max_y - frame.origin_y});
+            }
+        }
+    }
+
+    frames.publish();
+    return copied;
+}
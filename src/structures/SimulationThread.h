@@ -0,0 +1,116 @@
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include "particles/ParticleType.h"
+#include "structures/Brush.h"
+#include "structures/Grid.h"
+#include "structures/InputRecording.h"
+#include "structures/ParticleChunk.h"
+#include "util/SpscQueue.h"
+#include "util/TripleBuffer.h"
+
+#ifndef SIMULATION_THREAD_H
+#define SIMULATION_THREAD_H
+
+// Copy of the cells in view published after a tick, read by the render thread.
+// Uses the Grid's tiled layout, chunk_versions says which chunks changed. Cells
+// are indexed from the view's top left corner, origin_x and origin_y.
+struct FrameSnapshot {
+    int origin_x = 0, origin_y = 0;     // world cell at the top left, on a chunk edge
+    int width = 0, height = 0;
+    int chunks_x = 0, chunks_y = 0;
+    uint64_t tick = 0;
+
+    std::vector<uint8_t> type_ids;
+    std::vector<uint8_t> shades;
+    std::vector<ParticleTypeData> payloads;
+
+    // bumped whenever a chunk's cells change, compare against what was drawn last
+    std::vector<uint64_t> chunk_versions;
+
+    // only filled while debug info is requested
+    std::vector<uint8_t> debug_flags;       // DEBUG_CHANGED | DEBUG_UPDATED per cell
+    std::vector<DirtyRect> active_rects;    // rects simulated this tick, in view cells
+
+    static const uint8_t DEBUG_CHANGED = 1 << 0;
+    static const uint8_t DEBUG_UPDATED = 1 << 1;
+
+    inline int getIndex(int x, int y) const {
+        int chunk = (y >> ParticleChunk::CHUNK_SHIFT) * chunks_x + (x >> ParticleChunk::CHUNK_SHIFT);
+        int local = ((y & ParticleChunk::CHUNK_MASK) << ParticleChunk::CHUNK_SHIFT) | (x & ParticleChunk::CHUNK_MASK);
+        return chunk * ParticleChunk::CHUNK_AREA + local;
+    }
+};
+
+// Where one tick's time went on the simulation thread
+struct TickProfile {
+    uint64_t tick = 0;
+    uint64_t brush_ns = 0;      // painting brush strokes
+    uint64_t publish_ns = 0;    // copying changed chunks into the frame
+    int published_chunks = 0;   // chunks copied
+    TickStats stats;            // Grid's own phases and counters
+};
+
+// Runs Grid::processParticles() on its own thread at a fixed tick rate, so a
+// slow tick never holds up a frame. Once start() is called the Grid belongs to
+// this thread: input goes in through sendBrush(), the cells come out through
+// the published FrameSnapshots.
+class SimulationThread {
+public:
+    ~SimulationThread() {
+        stop();
+    }
+
+    // with a record_path every brush stroke is recorded until stop(), see InputRecording.h
+    void start(int tick_interval_ms, const std::string& record_path = "");
+    void stop();
+
+    // Event loop side, false if the queue is full and the command was dropped
+    bool sendBrush(const BrushCommand& command);
+
+    // Ask for the per cell debug flags and rects in the published frames
+    void setDebugInfo(bool enabled);
+
+    // Render side: the cells to publish, from world cell (x, y). The corner is
+    // moved to the chunk edge above and left of it, nothing is published
+    // before the first call
+    void setView(int x, int y, int width, int height);
+
+    // Render side: pick up the newest frame if there is one and return the latest
+    const FrameSnapshot& acquireFrame();
+
+    // Render side: the next tick's profile, false when there is none. Ticks that
+    // aren't picked up before the queue fills are dropped
+    bool popTickProfile(TickProfile& profile);
+
+private:
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<bool> debug_info{false};
+    std::atomic<uint64_t> view_corner{0};   // x << 32 | y
+    std::atomic<uint64_t> view_size{0};     // width << 32 | height
+    int tick_interval_ms = 10;
+
+    SpscQueue<BrushCommand, 256> brush_commands;
+    TripleBuffer<FrameSnapshot> frames;
+    SpscQueue<TickProfile, 1024> tick_profiles;
+
+    // simulation thread only
+    BrushCommand brush;
+    std::string record_path;
+    InputRecorder recorder;
+    uint64_t publish_count = 0;
+    // per chunk in view: the version of its contents, and the chunk and
+    // world index they were taken from
+    std::vector<uint64_t> view_versions;
+    std::vector<const ParticleChunk*> view_chunks;
+    std::vector<int> view_indices;
+
+    void run();
+    void applyBrush();
+    int publishFrame();  // returns the number of chunks copied
+};
+
+#endif // SIMULATION_THREAD_H
@@ -0,0 +1,155 @@
+#include "structures/TaskScheduler.h"
+#include <algorithm>
+
+// how many times an idle worker looks for work before parking
+static const int SPIN_ITERATIONS = 2000;
+
+// Initialize with specified number of threads
+void TaskScheduler::initializeThreads(int thread_count) {
+    terminate();
+
+    num_threads = std::max(thread_count, 1);
+
+    queues.clear();
+    for (int i = 0; i < num_threads; i++) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+
+    should_terminate = false;
+
+    // worker 0 is whoever calls parallelFor
+    for (int i = 1; i < num_threads; i++) {
+        threads.emplace_back(&TaskScheduler::workerLoop, this, i);
+    }
+}
+
+void TaskScheduler::parallelFor(int count, int grain, const RangeFunction& func) {
+    if (count <= 0) return;
+    grain = std::max(grain, 1);
+
+    // nothing to share, skip the queues entirely
+    if (num_threads == 1 || count <= grain) {
+        func(0, count, 0);
+        return;
+    }
+
+    current_function = &func;
+
+    int num_tasks = (count + grain - 1) / grain;
+    pending_tasks.store(num_tasks);
+
+    // deal the tasks out round robin, stealing evens out whatever is left
+    for (int t = 0; t < num_tasks; t++) {
+        WorkerQueue& queue = *queues[t % num_threads];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back({t * grain, std::min((t + 1) * grain, count)});
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        wake_epoch++;
+    }
+    wake_cv.notify_all();
+
+    runAvailableTasks(0);
+
+    // other workers may still be finishing stolen tasks
+    for (int i = 0; i < SPIN_ITERATIONS && pending_tasks.load(std::memory_order_acquire) > 0; i++) {
+        std::this_thread::yield();
+    }
+    if (pending_tasks.load(std::memory_order_acquire) > 0) {
+        std::unique_lock<std::mutex> lock(done_mutex);
+        done_cv.wait(lock, [this] { return pending_tasks.load(std::memory_order_acquire) == 0; });
+    }
+
+    current_function = nullptr;
+}
+
+void TaskScheduler::workerLoop(int worker_id) {
+    uint64_t seen_epoch = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            wake_cv.wait(lock, [&] { return should_terminate || wake_epoch != seen_epoch; });
+            if (should_terminate) return;
+            seen_epoch = wake_epoch;
+        }
+
+        // stay hot for a moment, the next phase usually follows right away
+        for (int i = 0; i < SPIN_ITERATIONS; i++) {
+            runAvailableTasks(worker_id);
+
+            if (should_terminate.load()) return;
+            uint64_t epoch = wake_epoch.load();
+            if (epoch != seen_epoch) {
+                seen_epoch = epoch;
+                i = 0;
+            }
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool TaskScheduler::popTask(int worker_id, Task& task) {
+    WorkerQueue& queue = *queues[worker_id];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) return false;
+
+    task = queue.tasks.back();
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool TaskScheduler::stealTask(int worker_id, Task& task) {
+    for (int i = 1; i < num_threads; i++) {
+        WorkerQueue& queue = *queues[(worker_id + i) % num_threads];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) continue;
+
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void TaskScheduler::runAvailableTasks(int worker_id) {
+    Task task;
+    while (popTask(worker_id, task) || stealTask(worker_id, task)) {
+        (*current_function)(task.begin, task.end, worker_id);
+        finishTask();
+    }
+}
+
+void TaskScheduler::finishTask() {
+    if (pending_tasks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard<std::mutex> lock(done_mutex);
+        done_cv.notify_all();
+    }
+}
+
+// Terminate all threads
+void TaskScheduler::terminate() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        should_terminate = true;
+    }
+    wake_cv.notify_all();
+
+    // Join all threads
+    for (auto& thread : threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    threads.clear();
+    queues.clear();
+    num_threads = 1;
+}
+
+// Get number of threads
+int TaskScheduler::getThreadCount() const {
+    return num_threads;
+}
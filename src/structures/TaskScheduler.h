@@ -0,0 +1,80 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+
+// Work stealing thread pool with a fork-join parallelFor.
+//
+// Every worker owns a deque of tasks. A worker pops from the back of its own
+// deque and, when that is empty, steals from the front of the others, so a
+// strip with a lot of work gets spread over the threads that finished early.
+// Idle workers spin for a short moment (phases of a tick come back to back)
+// and then park on a condition variable, so a paused simulation costs no CPU.
+class TaskScheduler {
+public:
+    // func(begin, end, worker_id) runs the items [begin, end)
+    using RangeFunction = std::function<void(int begin, int end, int worker_id)>;
+
+    TaskScheduler() = default;
+
+    ~TaskScheduler() {
+        terminate();
+    }
+
+    // Start thread_count - 1 threads, the thread calling parallelFor is worker 0
+    void initializeThreads(int thread_count);
+
+    // Split [0, count) into tasks of at most grain items, run them on all
+    // workers and return once every task has finished
+    void parallelFor(int count, int grain, const RangeFunction& func);
+
+    // Stop and join all threads
+    void terminate();
+
+    // Number of workers, including the calling thread
+    int getThreadCount() const;
+
+private:
+    struct Task {
+        int begin, end;
+    };
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+
+    const RangeFunction* current_function = nullptr;
+    std::atomic<int> pending_tasks{0};
+
+    // bumped for every parallelFor so parked workers know there's work,
+    // written under wake_mutex so a worker can't miss it while parking
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+    std::atomic<uint64_t> wake_epoch{0};
+    std::atomic<bool> should_terminate{false};
+
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+
+    int num_threads = 1;
+
+    void workerLoop(int worker_id);
+    bool popTask(int worker_id, Task& task);
+    bool stealTask(int worker_id, Task& task);
+    // run tasks until none are left to pop or steal
+    void runAvailableTasks(int worker_id);
+    void finishTask();
+};
+
+#endif // TASK_SCHEDULER_H
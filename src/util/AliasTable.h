@@ -0,0 +1,73 @@
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#ifndef ALIAS_TABLE_H
+#define ALIAS_TABLE_H
+
+// Weighted choice in O(1) using Vose's alias method. Built once from the
+// weights, sampling is one multiply and one compare and never allocates.
+struct AliasTable {
+    static const int MAX_ENTRIES = 16;
+
+    int size = 0;
+    std::array<uint32_t, MAX_ENTRIES> threshold{};  // keep the column when the roll is below this
+    std::array<uint8_t, MAX_ENTRIES> alias{};
+
+    AliasTable() = default;
+
+    AliasTable(const int* weights, int count) {
+        size = count < MAX_ENTRIES ? count : MAX_ENTRIES;
+        if (size <= 0) {
+            size = 0;
+            return;
+        }
+
+        double total = 0.0;
+        for (int i = 0; i < size; i++) {
+            total += weights ? weights[i] : 1;
+        }
+
+        // scaled so the average column holds exactly 1
+        std::array<double, MAX_ENTRIES> scaled{};
+        std::vector<int> small, large;
+        for (int i = 0; i < size; i++) {
+            double w = weights ? weights[i] : 1;
+            scaled[i] = total > 0.0 ? w * size / total : 1.0;
+            (scaled[i] < 1.0 ? small : large).push_back(i);
+        }
+
+        while (!small.empty() && !large.empty()) {
+            int s = small.back(); small.pop_back();
+            int l = large.back(); large.pop_back();
+
+            threshold[s] = toThreshold(scaled[s]);
+            alias[s] = static_cast<uint8_t>(l);
+
+            scaled[l] -= 1.0 - scaled[s];
+            (scaled[l] < 1.0 ? small : large).push_back(l);
+        }
+
+        // leftovers are full columns, up to rounding
+        for (int i : large) { threshold[i] = UINT32_MAX; alias[i] = static_cast<uint8_t>(i); }
+        for (int i : small) { threshold[i] = UINT32_MAX; alias[i] = static_cast<uint8_t>(i); }
+    }
+
+    // low 32 bits pick the column, high 32 bits pick between it and its alias
+    int sample(uint64_t random_bits) const {
+        if (size == 0) return 0;
+
+        uint32_t column = static_cast<uint32_t>(((random_bits & 0xffffffffULL) * static_cast<uint64_t>(size)) >> 32);
+        uint32_t roll = static_cast<uint32_t>(random_bits >> 32);
+        return roll < threshold[column] ? static_cast<int>(column) : alias[column];
+    }
+
+private:
+    static uint32_t toThreshold(double p) {
+        if (p >= 1.0) return UINT32_MAX;
+        if (p <= 0.0) return 0;
+        return static_cast<uint32_t>(p * 4294967296.0);
+    }
+};
+
+#endif // ALIAS_TABLE_H
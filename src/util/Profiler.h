@@ -0,0 +1,90 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Cheap wall clock timing for the tick and frame phases. A reading is a
+// single steady_clock call, so it stays on in release builds.
+namespace Profiler {
+    inline uint64_t now() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+}
+
+// Adds the time from construction to destruction to a nanosecond total
+class ScopedTimer {
+public:
+    explicit ScopedTimer(uint64_t& total) : total(total), start(Profiler::now()) {}
+    ~ScopedTimer() {
+        total += Profiler::now() - start;
+    }
+
+private:
+    uint64_t& total;
+    uint64_t start;
+};
+
+// Streams rows of named numbers to a file: CSV with a header line, or one
+// JSON object per line when the path ends in .json
+class ProfileLog {
+public:
+    ~ProfileLog() {
+        close();
+    }
+
+    bool open(const std::string& path, std::initializer_list<const char*> column_names) {
+        close();
+        file = fopen(path.c_str(), "w");
+        if(file == nullptr) return false;
+
+        json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+        columns.assign(column_names.begin(), column_names.end());
+        if(!json) {
+            for(size_t i = 0; i < columns.size(); i++) {
+                fprintf(file, i == 0 ? "%s" : ",%s", columns[i].c_str());
+            }
+            fprintf(file, "\n");
+        }
+        return true;
+    }
+
+    void close() {
+        if(file != nullptr) {
+            fclose(file);
+            file = nullptr;
+        }
+    }
+
+    bool isOpen() const { return file != nullptr; }
+
+    // one value per column, in the order given to open()
+    void write(std::initializer_list<double> values) {
+        if(file == nullptr) return;
+
+        size_t i = 0;
+        fprintf(file, json ? "{" : "");
+        for(double value : values) {
+            if(i >= columns.size()) break;
+            if(json) {
+                fprintf(file, i == 0 ? "\"%s\": %.15g" : ", \"%s\": %.15g", columns[i].c_str(), value);
+            }else{
+                fprintf(file, i == 0 ? "%.15g" : ",%.15g", value);
+            }
+            i++;
+        }
+        fprintf(file, json ? "}\n" : "\n");
+    }
+
+private:
+    FILE* file = nullptr;
+    bool json = false;
+    std::vector<std::string> columns;
+};
+
+#endif // PROFILER_H
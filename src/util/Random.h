@@ -0,0 +1,51 @@
+#include <cstdint>
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+// Counter based random numbers. Every draw is a hash of (seed, tick, cell,
+// stream, counter), so there is no generator state shared between threads and
+// a run only depends on the seed, not on which thread processed which cell.
+namespace Random {
+
+    // separate streams keep different behaviors at the same cell independent
+    enum Stream : uint32_t {
+        STREAM_SPREAD = 1,
+        STREAM_SPREAD_LIQUID = 2,
+        STREAM_REACTION = 3,
+        STREAM_SHADE = 4,
+        STREAM_SLIDE = 5,
+        STREAM_BRUSH = 6,
+    };
+
+    // SplitMix64 finalizer
+    inline uint64_t mix64(uint64_t z) {
+        z += 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    struct CellRandom {
+        uint64_t key;
+        uint64_t counter = 0;
+
+        CellRandom(uint64_t seed, uint64_t tick, int x, int y, uint32_t stream)
+            : key(mix64(seed ^ mix64(tick ^ mix64((static_cast<uint64_t>(static_cast<uint32_t>(y)) << 32 | static_cast<uint32_t>(x)) ^ (static_cast<uint64_t>(stream) << 56))))) {}
+
+        uint64_t next() {
+            return mix64(key + (++counter) * 0xd1b54a32d192ed03ULL);
+        }
+
+        bool nextBool() {
+            return next() >> 63;
+        }
+
+        // uniform in [0, n)
+        uint32_t nextBelow(uint32_t n) {
+            return static_cast<uint32_t>(((next() >> 32) * n) >> 32);
+        }
+    };
+}
+
+#endif // RANDOM_H
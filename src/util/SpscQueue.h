@@ -0,0 +1,43 @@
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+// Fixed size lock free queue for exactly one producer and one consumer thread.
+// Capacity must be a power of two, push() fails instead of blocking when full.
+template <typename T, size_t CAPACITY>
+class SpscQueue {
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // Producer side
+    bool push(const T& value) {
+        size_t tail = write_pos.load(std::memory_order_relaxed);
+        if(tail - read_pos.load(std::memory_order_acquire) == CAPACITY) return false;
+
+        items[tail & (CAPACITY - 1)] = value;
+        write_pos.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool pop(T& value) {
+        size_t head = read_pos.load(std::memory_order_relaxed);
+        if(head == write_pos.load(std::memory_order_acquire)) return false;
+
+        value = items[head & (CAPACITY - 1)];
+        read_pos.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::array<T, CAPACITY> items{};
+
+    // the two positions only ever grow, each on its own cache line
+    alignas(64) std::atomic<size_t> write_pos{0};
+    alignas(64) std::atomic<size_t> read_pos{0};
+};
+
+#endif // SPSC_QUEUE_H
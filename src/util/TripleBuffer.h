@@ -0,0 +1,48 @@
+#include <atomic>
+#include <cstdint>
+
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+// Lock free hand over of whole values from one writer thread to one reader.
+// The writer fills back() and publishes it, the reader picks up the newest
+// published value with consume() and reads it through front(). Neither side
+// ever waits, the reader just skips values the writer published in between.
+template <typename T>
+class TripleBuffer {
+public:
+    // Writer side: the value being filled, only valid until publish()
+    T& back() {
+        return slots[back_index];
+    }
+
+    // Writer side: make back() the newest value, and get a free slot to fill next
+    void publish() {
+        back_index = ready.exchange(back_index | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Reader side: switch front() to the newest published value.
+    // returns false if nothing was published since the last call
+    bool consume() {
+        if((ready.load(std::memory_order_relaxed) & FRESH_BIT) == 0) return false;
+
+        front_index = ready.exchange(front_index, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    // Reader side: the last consumed value
+    const T& front() const {
+        return slots[front_index];
+    }
+
+private:
+    static const uint8_t INDEX_MASK = 3;
+    static const uint8_t FRESH_BIT = 4;  // set while ready holds a value the reader hasn't seen
+
+    T slots[3];
+    int back_index = 0;
+    int front_index = 1;
+    std::atomic<uint8_t> ready{2};
+};
+
+#endif // TRIPLE_BUFFER_H
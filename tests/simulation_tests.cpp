@@ -0,0 +1,190 @@
+// Simulation tests run by ctest: snapshot round trips, replays of a recording
+// and the same world for any thread count. Each test is picked by name,
+// prints every check that failed and returns 1 if any did.
+//
+// usage: falling_sand_tests snapshot | replay | threads
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "structures/Grid.h"
+#include "structures/Brush.h"
+#include "structures/InputRecording.h"
+#include "particles/ParticleType.h"
+#include "scenes/Scene.h"
+
+
+static int failures = 0;
+
+static void check(bool passed, const char* what) {
+    if(!passed) {
+        fprintf(stderr, "FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static void checkChecksum(uint64_t actual, uint64_t expected, const char* what) {
+    if(actual != expected) {
+        fprintf(stderr, "FAILED: %s, checksum %016llx expected %016llx\n", what,
+            static_cast<unsigned long long>(actual), static_cast<unsigned long long>(expected));
+        failures++;
+    }
+}
+
+static void runTicks(int ticks) {
+    for(int i = 0; i < ticks; i++) {
+        Grid::processParticles();
+    }
+}
+
+static bool startScene(const std::string& scene, int width, int height, uint32_t seed) {
+    Grid::setSeed(seed);
+    Grid::init(width, height);
+    return Scenes::generate(scene, seed);
+}
+
+// A world saved mid run and loaded again carries on exactly like the original
+static void testSnapshot() {
+    Grid::setThreadCount(1);
+    Grid::setCheckerboardUpdate(false);
+
+    check(startScene("sand", 400, 225, 7), "generate the sand scene");
+    runTicks(100);
+    std::vector<uint8_t> bytes;
+    check(Grid::encodeSnapshot(bytes), "encode the sand scene");
+    uint64_t saved_checksum = Grid::computeChecksum();
+    uint64_t saved_tick = Grid::tick;
+    runTicks(100);
+    uint64_t expected = Grid::computeChecksum();
+    Grid::cleanup();
+
+    check(Grid::decodeSnapshot(bytes.data(), bytes.size(), "sand"), "decode the sand scene");
+    checkChecksum(Grid::computeChecksum(), saved_checksum, "sand scene right after decoding");
+    check(Grid::tick == saved_tick, "the snapshot keeps the tick");
+    runTicks(100);
+    checkChecksum(Grid::computeChecksum(), expected, "sand scene run on after decoding");
+    Grid::cleanup();
+
+    // a large world with one pile in it only stores the chunks the pile is in
+    Grid::setSeed(3);
+    Grid::init(4000, 4000);
+    Grid::fillCircle(2000, 2000, 40, ParticleTypeID::SAND);
+    Grid::fillCircle(2000, 2100, 30, ParticleTypeID::WATER);
+    runTicks(50);
+    bytes.clear();
+    check(Grid::encodeSnapshot(bytes), "encode the large world");
+    int allocated = Grid::getAllocatedChunkCount();
+    saved_checksum = Grid::computeChecksum();
+    check(bytes.size() < static_cast<size_t>(allocated + 1) * ParticleChunk::CHUNK_AREA * 8, "the large world stores only its allocated chunks");
+    runTicks(50);
+    expected = Grid::computeChecksum();
+    Grid::cleanup();
+
+    check(Grid::decodeSnapshot(bytes.data(), bytes.size(), "large world"), "decode the large world");
+    // chunks that emptied out but weren't given back yet come back unallocated
+    check(Grid::getAllocatedChunkCount() <= allocated, "the large world allocates no more chunks than it had");
+    checkChecksum(Grid::computeChecksum(), saved_checksum, "large world right after decoding");
+    runTicks(50);
+    checkChecksum(Grid::computeChecksum(), expected, "large world run on after decoding");
+    Grid::cleanup();
+}
+
+// A recording with strokes in it replays to the checksum it was recorded with,
+// on any thread count
+static void testReplay() {
+    const std::string path = "replay_test.fsr";
+    Grid::setThreadCount(2);
+    Grid::setCheckerboardUpdate(true);
+
+    check(startScene("mixed", 400, 225, 5), "generate the mixed scene");
+    InputRecorder recorder;
+    check(recorder.open(path), "open the recording");
+
+    std::mt19937 rng(5);
+    for(int i = 0; i < 300; i++) {
+        if(i % 3 == 0) {
+            BrushCommand command;
+            command.action = rng() % 4 == 0 ? BrushAction::REMOVE : BrushAction::PLACE;
+            command.type = static_cast<ParticleTypeID>(1 + rng() % 3);
+            command.radius = 2 + static_cast<int>(rng() % 7);
+            command.x = static_cast<int>(rng() % 400);
+            command.y = static_cast<int>(rng() % 225);
+            recorder.record(command);
+            Brush::apply(command);
+        }
+        Grid::processParticles();
+    }
+    check(recorder.close(), "finish the recording");
+    uint64_t expected = Grid::computeChecksum();
+    Grid::cleanup();
+
+    for(int threads : {1, 2, 4}) {
+        Grid::setThreadCount(threads);
+        InputReplay replay;
+        check(replay.open(path), "open the recording for replay");
+        check(replay.isComplete(), "the recording has its final checksum");
+        checkChecksum(replay.getExpectedChecksum(), expected, "checksum stored in the recording");
+
+        Grid::setCheckerboardUpdate(replay.isCheckerboard());
+        Grid::setLiquidLevelling(replay.isLiquidLevelling());
+        Grid::setMaterialReactions(replay.isMaterialReactions());
+        Grid::setBitboardUpdate(replay.isBitboard());
+        while(replay.applyTick()) {
+            Grid::processParticles();
+        }
+        checkChecksum(Grid::computeChecksum(), expected, ("replay on " + std::to_string(threads) + " threads").c_str());
+        Grid::cleanup();
+    }
+    std::remove(path.c_str());
+}
+
+// The checkerboard update ends in the same world on 1 thread and on several
+static void testThreads() {
+    Grid::setCheckerboardUpdate(true);
+
+    for(const char* scene : {"sand", "water", "mixed", "tank"}) {
+        for(bool bitboard : {false, true}) {
+            Grid::setBitboardUpdate(bitboard);
+            uint64_t expected = 0;
+            for(int threads : {1, 2, 4}) {
+                Grid::setThreadCount(threads);
+                check(startScene(scene, 400, 225, 11), "generate the scene");
+                runTicks(300);
+                uint64_t checksum = Grid::computeChecksum();
+                Grid::cleanup();
+
+                if(threads == 1) {
+                    expected = checksum;
+                }else{
+                    std::string what = std::string(scene) + (bitboard ? " with the bitboard update" : "") + " on " + std::to_string(threads) + " threads";
+                    checkChecksum(checksum, expected, what.c_str());
+                }
+            }
+        }
+    }
+    Grid::setBitboardUpdate(false);
+}
+
+int main(int argc, char* argv[]) {
+    if(argc != 2) {
+        printf("usage: %s snapshot | replay | threads\n", argv[0]);
+        return 1;
+    }
+
+    ParticleTypeRegistry::initialize();
+    if(strcmp(argv[1], "snapshot") == 0) {
+        testSnapshot();
+    }else if(strcmp(argv[1], "replay") == 0) {
+        testReplay();
+    }else if(strcmp(argv[1], "threads") == 0) {
+        testThreads();
+    }else{
+        fprintf(stderr, "Unknown test: %s\n", argv[1]);
+        return 1;
+    }
+
+    printf("%s: %s\n", argv[1], failures == 0 ? "passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
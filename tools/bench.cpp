@@ -0,0 +1,198 @@
+// Scenario benchmark: runs a fixed set of reproducible workloads and prints one result per scenario
+// in a machine readable form, so runs can be compared across commits.
+//
+// usage: falling_sand_bench [--scenario NAME] [--ticks N] [--width W] [--height H]
+//                           [--seed S] [--threads T] [--bitboard] [--format json|csv]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#ifdef __unix__
+#include <sys/resource.h>
+#endif
+#include "structures/Grid.h"
+#include "particles/ParticleType.h"
+#include "particles/ParticleFactory.h"
+#include "scenes/Scene.h"
+
+
+struct Scenario {
+    const char* name;
+    const char* scene;
+    int default_ticks;
+    bool water_emitter;     // pours water in from the top every tick
+    bool reactions;         // runs the material reactions
+};
+
+static const Scenario SCENARIOS[] = {
+    {"avalanche", "sand", 600, false, true},    // a sand pile collapsing
+    {"tank", "tank", 1000, true, true},         // a stone tank filling up with water
+    {"cave", "mixed", 600, false, true},        // sand and water falling through stone ledges
+    {"idle", "idle", 1000, false, false},       // a settled world where nothing should move
+    {"soaked", "soaked", 1000, false, true},    // the same with reactions that have nothing left to do
+};
+
+struct Result {
+    const Scenario* scenario;
+    int ticks;
+    double seconds;
+    uint64_t moved;
+    long peak_rss_kb;
+    uint64_t checksum;
+};
+
+static void printUsage(const char* exe) {
+    printf("usage: %s [--scenario NAME] [--ticks N] [--width W] [--height H] [--seed S] [--threads T] [--bitboard] [--format json|csv]\n", exe);
+    printf("scenarios:");
+    for(const Scenario& scenario : SCENARIOS) {
+        printf(" %s", scenario.name);
+    }
+    printf("\n");
+}
+
+// process wide high water mark, so later scenarios report at least the peak of the earlier ones
+static long getPeakRssKb() {
+#ifdef __unix__
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0) {
+        return usage.ru_maxrss;
+    }
+#endif
+    return -1;
+}
+
+static void emitWater() {
+    int x0 = Grid::width / 3;
+    int x1 = Grid::width / 2;
+    for(int x = x0; x < x1; x++) {
+        if(Grid::isCellEmpty(x, 0)) {
+            uint64_t bits = Grid::random(x, 0, Random::STREAM_SHADE).next();
+            Grid::setParticle(x, 0, ParticleFactory::createParticle(ParticleTypeID::WATER, bits));
+        }
+    }
+}
+
+static Result runScenario(const Scenario& scenario, int width, int height, int ticks, uint32_t seed, int threads) {
+    Grid::setSeed(seed);
+    Grid::init(width, height);
+    Scenes::generate(scenario.scene, seed);
+
+    Grid::setThreadCount(threads);
+    Grid::setCheckerboardUpdate(threads > 1);
+    Grid::setMaterialReactions(scenario.reactions);
+
+    Result result = {};
+    result.scenario = &scenario;
+    result.ticks = ticks;
+
+    auto t0 = std::chrono::steady_clock::now();
+    for(int i = 0; i < ticks; i++) {
+        if(scenario.water_emitter) {
+            emitWater();
+        }
+        Grid::processParticles();
+        result.moved += Grid::getLastTickStats().swaps;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    result.seconds = std::chrono::duration<double>(t1 - t0).count();
+    result.peak_rss_kb = getPeakRssKb();
+    result.checksum = Grid::computeChecksum();
+
+    Grid::cleanup();
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    std::string only;
+    std::string format = "json";
+    int width = 480;
+    int height = 270;
+    int ticks = 0;          // 0 uses each scenario's own tick count
+    uint32_t seed = 1;
+    int threads = 1;
+    bool bitboard = false;
+
+    for(int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if(strcmp(arg, "--scenario") == 0 && has_value) {
+            only = argv[++i];
+        }else if(strcmp(arg, "--ticks") == 0 && has_value) {
+            ticks = atoi(argv[++i]);
+        }else if(strcmp(arg, "--width") == 0 && has_value) {
+            width = atoi(argv[++i]);
+        }else if(strcmp(arg, "--height") == 0 && has_value) {
+            height = atoi(argv[++i]);
+        }else if(strcmp(arg, "--seed") == 0 && has_value) {
+            seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        }else if(strcmp(arg, "--threads") == 0 && has_value) {
+            threads = atoi(argv[++i]);
+        }else if(strcmp(arg, "--bitboard") == 0) {
+            bitboard = true;
+        }else if(strcmp(arg, "--format") == 0 && has_value) {
+            format = argv[++i];
+        }else{
+            printUsage(argv[0]);
+            return strcmp(arg, "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    if(width <= 0 || height <= 0 || ticks < 0 || threads < 1 || (format != "json" && format != "csv")) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    ParticleTypeRegistry::initialize();
+    Grid::setBitboardUpdate(bitboard);
+
+    std::vector<Result> results;
+    for(const Scenario& scenario : SCENARIOS) {
+        if(!only.empty() && only != scenario.name) {
+            continue;
+        }
+        results.push_back(runScenario(scenario, width, height, ticks > 0 ? ticks : scenario.default_ticks, seed, threads));
+    }
+
+    if(results.empty()) {
+        fprintf(stderr, "Unknown scenario: %s\n", only.c_str());
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    double cells = static_cast<double>(width) * height;
+
+    if(format == "csv") {
+        printf("scenario,width,height,ticks,threads,seed,seconds,ticks_per_sec,ns_per_cell,moved_per_tick,peak_rss_kb,checksum\n");
+    }else{
+        printf("[\n");
+    }
+
+    for(size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        double ticks_per_sec = r.seconds > 0.0 ? r.ticks / r.seconds : 0.0;
+        double ns_per_cell = r.ticks > 0 ? r.seconds * 1e9 / (r.ticks * cells) : 0.0;
+        double moved_per_tick = r.ticks > 0 ? static_cast<double>(r.moved) / r.ticks : 0.0;
+        unsigned long long checksum = static_cast<unsigned long long>(r.checksum);
+
+        if(format == "csv") {
+            printf("%s,%d,%d,%d,%d,%u,%.6f,%.1f,%.3f,%.1f,%ld,%016llx\n", r.scenario->name, width, height, r.ticks,
+                threads, seed, r.seconds, ticks_per_sec, ns_per_cell, moved_per_tick, r.peak_rss_kb, checksum);
+        }else{
+            printf("  {\"scenario\": \"%s\", \"width\": %d, \"height\": %d, \"ticks\": %d, \"threads\": %d, \"seed\": %u, "
+                "\"seconds\": %.6f, \"ticks_per_sec\": %.1f, \"ns_per_cell\": %.3f, \"moved_per_tick\": %.1f, "
+                "\"peak_rss_kb\": %ld, \"checksum\": \"%016llx\"}%s\n", r.scenario->name, width, height, r.ticks,
+                threads, seed, r.seconds, ticks_per_sec, ns_per_cell, moved_per_tick, r.peak_rss_kb, checksum,
+                i + 1 < results.size() ? "," : "");
+        }
+    }
+
+    if(format != "csv") {
+        printf("]\n");
+    }
+    return 0;
+}
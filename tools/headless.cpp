@@ -0,0 +1,200 @@
+// Headless driver: builds a scene and runs the simulation without any window or renderer.
+//
+// usage: falling_sand_headless [--scene NAME | --load FILE] [--width W] [--height H]
+//                              [--ticks N] [--seed S] [--threads T] [--checkerboard] [--save FILE]
+//                              [--profile FILE] [--no-levelling] [--reactions | --no-reactions] [--bitboard]
+//                              [--paint-every N] [--record FILE]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <array>
+#include <random>
+#include <string>
+#include "structures/Grid.h"
+#include "structures/Brush.h"
+#include "structures/InputRecording.h"
+#include "particles/ParticleType.h"
+#include "scenes/Scene.h"
+#include "util/Profiler.h"
+
+
+static void printUsage(const char* exe) {
+    printf("usage: %s [--scene NAME | --load FILE] [--width W] [--height H] [--ticks N] [--seed S] [--threads T] [--checkerboard] [--save FILE] [--profile FILE] [--no-levelling] [--reactions | --no-reactions] [--bitboard] [--paint-every N] [--record FILE]\n", exe);
+    printf("scenes:");
+    for(const std::string& name : Scenes::names()) {
+        printf(" %s", name.c_str());
+    }
+    printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+    std::string scene = "sand";
+    std::string load_path;
+    std::string save_path;
+    std::string profile_path;
+    std::string record_path;
+    int width = 400;
+    int height = 225;
+    int ticks = 1000;
+    uint32_t seed = 1;
+    int threads = 1;
+    bool checkerboard = false;
+    bool levelling = true;
+    int reactions = -1;     // -1 leaves it to the scene
+    bool bitboard = false;
+    int paint_every = 0;    // ticks between scripted brush strokes, 0 for none
+
+    for(int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if(strcmp(arg, "--scene") == 0 && has_value) {
+            scene = argv[++i];
+        }else if(strcmp(arg, "--load") == 0 && has_value) {
+            load_path = argv[++i];
+        }else if(strcmp(arg, "--width") == 0 && has_value) {
+            width = atoi(argv[++i]);
+        }else if(strcmp(arg, "--height") == 0 && has_value) {
+            height = atoi(argv[++i]);
+        }else if(strcmp(arg, "--ticks") == 0 && has_value) {
+            ticks = atoi(argv[++i]);
+        }else if(strcmp(arg, "--seed") == 0 && has_value) {
+            seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        }else if(strcmp(arg, "--threads") == 0 && has_value) {
+            threads = atoi(argv[++i]);
+        }else if(strcmp(arg, "--save") == 0 && has_value) {
+            save_path = argv[++i];
+        }else if(strcmp(arg, "--profile") == 0 && has_value) {
+            profile_path = argv[++i];
+        }else if(strcmp(arg, "--record") == 0 && has_value) {
+            record_path = argv[++i];
+        }else if(strcmp(arg, "--paint-every") == 0 && has_value) {
+            paint_every = atoi(argv[++i]);
+        }else if(strcmp(arg, "--checkerboard") == 0) {
+            checkerboard = true;
+        }else if(strcmp(arg, "--no-levelling") == 0) {
+            levelling = false;
+        }else if(strcmp(arg, "--reactions") == 0) {
+            reactions = 1;
+        }else if(strcmp(arg, "--no-reactions") == 0) {
+            reactions = 0;
+        }else if(strcmp(arg, "--bitboard") == 0) {
+            bitboard = true;
+        }else{
+            printUsage(argv[0]);
+            return strcmp(arg, "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    if(width <= 0 || height <= 0 || ticks < 0 || threads < 1 || paint_every < 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    ParticleTypeRegistry::initialize();
+    Grid::setSeed(seed);
+    Grid::setThreadCount(threads);
+
+    if(!load_path.empty()) {
+        // snapshots bring their own seed and tick, anything else is read as a text scene
+        bool loaded = Grid::isSnapshotFile(load_path) ? Grid::loadSnapshot(load_path) : Scenes::loadText(load_path);
+        if(!loaded) {
+            fprintf(stderr, "Couldn't load scene file: %s\n", load_path.c_str());
+            return 1;
+        }
+        scene = load_path;
+    }else{
+        Grid::init(width, height);
+        if(!Scenes::generate(scene, seed)) {
+            fprintf(stderr, "Unknown scene: %s\n", scene.c_str());
+            printUsage(argv[0]);
+            Grid::cleanup();
+            return 1;
+        }
+    }
+
+    // more than one thread needs the checkerboard update
+    Grid::setCheckerboardUpdate(checkerboard || threads > 1);
+    Grid::setLiquidLevelling(levelling);
+    // idle is water lying on dry sand, which reactions would soak, so it
+    // only stays at rest without them, like the bench's idle scenario
+    Grid::setMaterialReactions(reactions >= 0 ? reactions == 1 : scene != "idle");
+    Grid::setBitboardUpdate(bitboard);
+
+    printf("scene: %s  size: %dx%d  ticks: %d  threads: %d  update: %s%s%s\n", scene.c_str(), Grid::width, Grid::height,
+        ticks, threads, Grid::isCheckerboardUpdate() ? "checkerboard" : "serial", Grid::isBitboardUpdate() ? " bitboard" : "",
+        Grid::isMaterialReactions() ? "" : " no-reactions");
+
+    // one row per tick, CSV or .json
+    ProfileLog profile_log;
+    if(!profile_path.empty() && !profile_log.open(profile_path, {"tick", "stamp_us", "activate_us", "sweep_us",
+        "react_us", "level_us", "swaps", "reacted", "levelled", "active_chunks", "allocated_chunks"})) {
+        fprintf(stderr, "Couldn't open profile log: %s\n", profile_path.c_str());
+    }
+
+    // the recording takes the update flags set above, falling_sand_replay checks it
+    InputRecorder recorder;
+    if(!record_path.empty() && !recorder.open(record_path)) {
+        fprintf(stderr, "Couldn't record to %s\n", record_path.c_str());
+        Grid::cleanup();
+        return 1;
+    }
+
+    // scripted strokes stand in for a player, picked from the seed
+    static const ParticleTypeID PAINT_TYPES[3] = {ParticleTypeID::SAND, ParticleTypeID::WATER, ParticleTypeID::STONE};
+    std::mt19937 paint_rng(seed);
+
+    auto t0 = std::chrono::steady_clock::now();
+    for(int i = 0; i < ticks; i++) {
+        uint64_t tick = Grid::tick;
+        if(paint_every > 0 && i % paint_every == 0) {
+            BrushCommand command;
+            command.action = paint_rng() % 4 == 0 ? BrushAction::REMOVE : BrushAction::PLACE;
+            command.type = PAINT_TYPES[paint_rng() % 3];
+            command.radius = 2 + static_cast<int>(paint_rng() % 7);
+            command.x = static_cast<int>(paint_rng() % static_cast<uint32_t>(Grid::width));
+            command.y = static_cast<int>(paint_rng() % static_cast<uint32_t>(Grid::height));
+            recorder.record(command);
+            Brush::apply(command);
+        }
+        Grid::processParticles();
+
+        const TickStats& stats = Grid::getLastTickStats();
+        profile_log.write({static_cast<double>(tick), stats.stamp_ns / 1e3, stats.activate_ns / 1e3, stats.sweep_ns / 1e3,
+            stats.react_ns / 1e3, stats.level_ns / 1e3, static_cast<double>(stats.swaps), static_cast<double>(stats.reacted),
+            static_cast<double>(stats.levelled),
+            static_cast<double>(stats.active_chunks), static_cast<double>(stats.allocated_chunks)});
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(t1 - t0).count();
+    double ticks_per_sec = seconds > 0.0 ? ticks / seconds : 0.0;
+    printf("elapsed: %.3f s  ticks/sec: %.1f\n", seconds, ticks_per_sec);
+    printf("checksum: %016llx\n", static_cast<unsigned long long>(Grid::computeChecksum()));
+
+    static const char* TYPE_NAMES[NUM_PARTICLE_TYPES] = {"empty", "sand", "water", "stone", "wet_sand"};
+    std::array<uint64_t, NUM_PARTICLE_TYPES> census = Grid::getMaterialCensus();
+    printf("census:");
+    for(int type = 0; type < NUM_PARTICLE_TYPES; type++) {
+        printf(" %s=%llu", TYPE_NAMES[type], static_cast<unsigned long long>(census[type]));
+    }
+    printf("\n");
+    printf("chunks: %d allocated of %zu\n", Grid::getAllocatedChunkCount(), Grid::particleChunks.size());
+
+    if(recorder.isOpen() && !recorder.close()) {
+        fprintf(stderr, "Couldn't finish recording %s\n", record_path.c_str());
+        Grid::cleanup();
+        return 1;
+    }
+
+    if(!save_path.empty() && !Grid::saveSnapshot(save_path)) {
+        fprintf(stderr, "Couldn't save snapshot: %s\n", save_path.c_str());
+        Grid::cleanup();
+        return 1;
+    }
+
+    Grid::cleanup();
+    return 0;
+}